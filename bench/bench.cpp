@@ -0,0 +1,126 @@
+// Runner for the native benchmarks. Usage: program [substring-filter]
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+  #include <x86intrin.h>
+  #define BENCH_CYCLES() __rdtsc()
+#else
+  #define BENCH_CYCLES() 0ULL
+#endif
+
+#include "Arduino.h"
+#include "sim.h"
+
+namespace {
+  struct entry {
+    const char *name;
+    bench::function fn;
+  };
+
+  std::vector<entry> &registry()
+  {
+    static std::vector<entry> entries;
+    return entries;
+  }
+
+  const double MIN_SECONDS = 0.5;
+  const uint64_t MAX_ITERATIONS = 1000000000ULL;
+
+  const uint8_t chip_selects[] = { 10, 9, 8, 7, 6, 5, 4, 3 };
+}
+
+bench::State::State(uint64_t iterations)
+  : _iterations(iterations), _bytes(0), _counter_count(0), _failure(NULL)
+{
+}
+
+void bench::State::counter(const char *name, double value)
+{
+  for (uint8_t i = 0; i < _counter_count; i++) {
+    if (strcmp(_counter_names[i], name) == 0) {
+      _counter_values[i] = value;
+      return;
+    }
+  }
+  if (_counter_count < MAX_COUNTERS) {
+    _counter_names[_counter_count] = name;
+    _counter_values[_counter_count] = value;
+    _counter_count++;
+  }
+}
+
+bench::registration::registration(const char *name, function fn)
+{
+  registry().push_back(entry { name, fn });
+}
+
+// Returns false if the benchmark failed a check.
+static bool run(const entry &e)
+{
+  uint64_t iterations = 1;
+  for (;;) {
+    bench::State state(iterations);
+    auto start = std::chrono::steady_clock::now();
+    uint64_t start_cycles = BENCH_CYCLES();
+    e.fn(state);
+    uint64_t cycles = BENCH_CYCLES() - start_cycles;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (seconds >= MIN_SECONDS || iterations >= MAX_ITERATIONS) {
+      printf("%-36s %10llu %14.1f ns/op", e.name, (unsigned long long)iterations, seconds * 1e9 / iterations);
+      if (cycles) {
+        printf(" %12.1f cycles/op", (double)cycles / iterations);
+      }
+      if (state.bytes_processed()) {
+        printf(" %9.1f B/op %9.2f MB/s",
+          (double)state.bytes_processed() / iterations,
+          state.bytes_processed() / seconds / 1e6);
+      }
+      for (uint8_t i = 0; i < state.counter_count(); i++) {
+        printf("  %s=%g", state.counter_name(i), state.counter_value(i));
+      }
+      if (state.failure()) {
+        printf("  FAILED: %s", state.failure());
+      }
+      printf("\n");
+      fflush(stdout);
+      return !state.failure();
+    }
+
+    double predicted = seconds > 0 ? iterations * MIN_SECONDS * 1.4 / seconds : iterations * 100.0;
+    uint64_t next = predicted > iterations * 100.0 ? iterations * 100 : (uint64_t)predicted;
+    iterations = next > iterations ? next : iterations + 1;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  const char *filter = argc > 1 ? argv[1] : "";
+
+  for (uint8_t i = 0; i < sizeof(chip_selects); i++) {
+    sim::max31855::attach(chip_selects[i], 180.25 + i, 24.0625);
+  }
+
+  // Boot the firmware once with its output thrown away.
+  sim::serial::set_output(sim::serial::output::discard);
+  setup();
+
+  printf("# %d channel build\n", BENCH_CHANNELS);
+  int failed = 0;
+  for (const entry &e : registry()) {
+    if (strstr(e.name, filter) && !run(e)) {
+      failed++;
+    }
+  }
+  if (failed) {
+    printf("# %d benchmark(s) failed\n", failed);
+  }
+  return failed ? 1 : 0;
+}
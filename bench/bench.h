@@ -0,0 +1,87 @@
+#ifndef _GGH_BENCH_H_
+#define _GGH_BENCH_H_
+
+// Minimal benchmark harness for the native environments. A benchmark is a
+// function taking a bench::State; it runs its body state.iterations() times
+// and the runner scales the count until a run takes long enough to time.
+// cycles/op is the host TSC where available, not AVR cycles.
+//
+// The figures are for reading, not for passing or failing, except where a
+// benchmark checks a result it must get right and calls state.fail(): the
+// runner then exits non-zero.
+//
+//   static void driver_update(bench::State &state) {
+//     for (uint64_t i = 0; i < state.iterations(); i++) { ... }
+//   }
+//   BENCHMARK("driver/update", driver_update);
+
+#include <stdint.h>
+
+#include "Arduino.h"
+
+#ifdef HAS_8_CHANNELS
+  #define BENCH_CHANNELS 8
+#else
+  #define BENCH_CHANNELS 4
+#endif
+
+namespace bench {
+
+  class State {
+  public:
+    explicit State(uint64_t iterations);
+
+    uint64_t iterations() const { return _iterations; }
+
+    // Total bytes produced by the whole run; reported as bytes/op and MB/s.
+    void set_bytes_processed(uint64_t bytes) { _bytes = bytes; }
+
+    // Extra per-run figure reported verbatim, e.g. allocations per op.
+    void counter(const char *name, double value);
+    // Marks the run as wrong, not just slow. The last reason is reported.
+    void fail(const char *reason) { _failure = reason; }
+
+    uint64_t bytes_processed() const { return _bytes; }
+    uint8_t counter_count() const { return _counter_count; }
+    const char *counter_name(uint8_t i) const { return _counter_names[i]; }
+    double counter_value(uint8_t i) const { return _counter_values[i]; }
+    const char *failure() const { return _failure; }
+
+  private:
+    static const uint8_t MAX_COUNTERS = 6;
+
+    uint64_t _iterations;
+    uint64_t _bytes;
+    uint8_t _counter_count;
+    const char *_counter_names[MAX_COUNTERS];
+    double _counter_values[MAX_COUNTERS];
+    const char *_failure;
+  };
+
+  typedef void (*function)(State &state);
+
+  struct registration {
+    registration(const char *name, function fn);
+  };
+
+  // Print that throws its output away.
+  class NullPrint : public Print {
+  public:
+    virtual size_t write(uint8_t) { return 1; }
+    virtual size_t write(const uint8_t *, size_t size) { return size; }
+    using Print::write;
+  };
+
+  // Keeps the optimizer from discarding a computed value.
+  template <typename T> inline void do_not_optimize(const T &value)
+  {
+    asm volatile("" : : "r,m"(value) : "memory");
+  }
+};
+
+#define BENCH_CONCAT_(a, b) a##b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT_(a, b)
+#define BENCHMARK(name, fn) \
+  static bench::registration BENCH_CONCAT(bench_registration_, __LINE__)(name, fn)
+
+#endif // _GGH_BENCH_H_
@@ -0,0 +1,72 @@
+// Per sample cost of the channel alarms, and how long an alarm event takes
+// to reach the serial port while a slow stream keeps the link busy.
+
+#include "bench.h"
+
+#include "alarm.h"
+#include "sim.h"
+
+#include <string>
+
+static void alarm_update(bench::State &state)
+{
+  safety::Alarm a;
+  a.configure(800, 0, 8, 8);
+  a.arm(safety::ALL, 0);
+  uint64_t changes = 0;
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    // sweeps every 10 ms, crossing the high threshold every 64 sweeps
+    changes += a.update((uint32_t)i * 10, true, (int16_t)(780 + (i & 63)));
+  }
+  bench::do_not_optimize(a);
+  state.counter("changes/op", (double)changes / state.iterations());
+}
+BENCHMARK("alarm/update", alarm_update);
+
+extern bool gStreamingTemperatureEnabled;
+extern bool gStreamingStatusEnabled;
+extern uint16_t gStreamingDelay;
+extern void restartStreaming();
+
+// Channel 0 swings across a 100 C alarm threshold while JSON frames stream
+// every 2 s over a 115200 baud link. Each op is one raised or cleared alarm,
+// timed in simulated ms from the temperature change to the event leaving
+// the firmware. That covers the chip's 100 ms conversion, the sweep and the
+// wait for the piece going out, but not the stream period.
+static void loop_alarm_latency(bench::State &state)
+{
+  sim::serial::set_output(sim::serial::output::capture);
+  sim::serial::set_line_rate(115200);
+  sim::serial::feed("A C0 400 0;A E0 1\n");
+  gStreamingTemperatureEnabled = true;
+  gStreamingStatusEnabled = false;
+  gStreamingDelay = 2000;
+  restartStreaming();
+
+  uint64_t total_ms = 0;
+  uint64_t worst_ms = 0;
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    sim::max31855::set_temperature(10, i & 1 ? 20.0 : 180.25, 24.0625);
+    sim::serial::clear_captured();
+    uint64_t ms = 0;
+    while (sim::serial::captured().find("\"alarm\"") == std::string::npos && ms < 10000) {
+      sim::clock::advance_micros(1000);
+      loop();
+      ms++;
+    }
+    total_ms += ms;
+    worst_ms = ms > worst_ms ? ms : worst_ms;
+  }
+  state.counter("avg_ms", (double)total_ms / state.iterations());
+  state.counter("max_ms", (double)worst_ms);
+
+  sim::serial::feed("A E0 0\n");
+  sim::max31855::set_temperature(10, 180.25, 24.0625);
+  gStreamingTemperatureEnabled = false;
+  restartStreaming();
+  sim::serial::set_line_rate(0);
+  loop();
+  loop();
+  sim::serial::set_output(sim::serial::output::discard);
+}
+BENCHMARK("loop/alarm_latency", loop_alarm_latency);
@@ -0,0 +1,205 @@
+// Cost of tokenizing and dispatching a command line, without running it.
+
+#include "bench.h"
+
+#include <string.h>
+
+#include "command_parser.h"
+
+static command::error noop(const command::Args &args)
+{
+  bench::do_not_optimize(args.count());
+  return command::error::NONE;
+}
+
+static const command::entry commands[] PROGMEM = {
+  { 'T', 'E', noop },
+  { 'T', 'D', noop },
+  { 'T', 'O', noop },
+  { 'T', 'S', noop },
+  { 'D', 'C', noop },
+  { 'H', 'W', noop },
+  { 'S', 0,   noop }
+};
+
+static void parse_line(bench::State &state, const char *line)
+{
+  size_t length = strlen(line);
+  command::Parser parser;
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    for (size_t j = 0; j < length; j++) {
+      if (parser.feed(line[j])) {
+        command::error status = command::dispatch(commands, sizeof(commands) / sizeof(commands[0]), parser.args());
+        bench::do_not_optimize(status);
+      }
+    }
+  }
+  state.set_bytes_processed(state.iterations() * length);
+}
+
+static void command_parse_short(bench::State &state)
+{
+  parse_line(state, "T E0\n");
+}
+BENCHMARK("command/parse_short", command_parse_short);
+
+static void command_parse_long(bench::State &state)
+{
+  parse_line(state, "D C 1000 2000;T S1 500\n");
+}
+BENCHMARK("command/parse_long", command_parse_long);
+
+// Reconfiguring every channel (deadband, filter and sampling period) and
+// the stream, as request-tagged commands, while status frames stream every
+// 10 ms over a 115200 baud link. setup_ms is the simulated time from the
+// first command to the last acknowledgement. Lock-step sends a command only
+// once the previous one is acknowledged. Pipelined keeps up to the 64 byte
+// RX buffer of unacknowledged commands in flight, counting characters.
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "sim.h"
+
+extern bool gStreamingTemperatureEnabled;
+extern bool gStreamingStatusEnabled;
+extern uint16_t gStreamingDelay;
+extern void restartStreaming();
+
+static uint64_t run_setup(size_t window)
+{
+  std::vector<std::string> commands;
+  char line[command::MAX_LINE_LENGTH];
+  for (uint8_t c = 0; c < BENCH_CHANNELS; c++) {
+    snprintf(line, sizeof(line), "N%u T B%u 4\n", (unsigned)commands.size() + 1, c);
+    commands.push_back(line);
+    snprintf(line, sizeof(line), "N%u T F%u 1\n", (unsigned)commands.size() + 1, c);
+    commands.push_back(line);
+    snprintf(line, sizeof(line), "N%u T R%u 100\n", (unsigned)commands.size() + 1, c);
+    commands.push_back(line);
+  }
+  snprintf(line, sizeof(line), "N%u S1 10\n", (unsigned)commands.size() + 1);
+  commands.push_back(line);
+
+  sim::serial::clear_captured();
+  size_t scanned = 0;
+  size_t next = 0;
+  size_t acked = 0;
+  std::deque<size_t> in_flight;
+  size_t in_flight_bytes = 0;
+  uint64_t ms = 0;
+  while (acked < commands.size() && ms < 60000) {
+    while (next < commands.size() &&
+           (in_flight.empty() || in_flight_bytes + commands[next].size() <= window)) {
+      sim::serial::feed(commands[next].c_str());
+      in_flight.push_back(commands[next].size());
+      in_flight_bytes += commands[next].size();
+      next++;
+    }
+    sim::clock::advance_micros(1000);
+    loop();
+    ms++;
+    const std::string &out = sim::serial::captured();
+    size_t found;
+    while ((found = out.find("\"id\": ", scanned)) != std::string::npos) {
+      scanned = found + 1;
+      acked++;
+      in_flight_bytes -= in_flight.front();
+      in_flight.pop_front();
+    }
+  }
+  return ms;
+}
+
+static void command_setup(bench::State &state, size_t window)
+{
+  sim::serial::set_output(sim::serial::output::capture);
+  sim::serial::set_line_rate(115200);
+  gStreamingTemperatureEnabled = false;
+  gStreamingStatusEnabled = true;
+  gStreamingDelay = 10;
+  restartStreaming();
+
+  uint64_t total_ms = 0;
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    total_ms += run_setup(window);
+  }
+  state.counter("setup_ms", (double)total_ms / state.iterations());
+
+  gStreamingStatusEnabled = false;
+  restartStreaming();
+  sim::serial::set_line_rate(0);
+  loop();
+  sim::serial::clear_captured();
+  sim::serial::set_output(sim::serial::output::discard);
+}
+
+static void command_setup_lockstep(bench::State &state)
+{
+  command_setup(state, 1);
+}
+BENCHMARK("command/setup_lockstep", command_setup_lockstep);
+
+static void command_setup_pipelined(bench::State &state)
+{
+  command_setup(state, SERIAL_RX_BUFFER_SIZE);
+}
+BENCHMARK("command/setup_pipelined", command_setup_pipelined);
+
+// Latency of one request-tagged command while status frames stream back to
+// back over a 115200 baud link. One op sends T Q at a different point of
+// the stream each time and steps loop() every 100 us of simulated time
+// until the ack is written to the port. avg_ms and max_ms are that time,
+// including the waits for room in the TX buffer, so about 6 ms of it is
+// the reply itself going out at 115200 baud. start_ms is the average time
+// until the reply starts. A reply waits for the piece of the frame going
+// out, not the whole frame.
+static void command_reply_latency(bench::State &state)
+{
+  sim::serial::set_output(sim::serial::output::capture);
+  sim::serial::set_line_rate(115200);
+  gStreamingTemperatureEnabled = false;
+  gStreamingStatusEnabled = true;
+  gStreamingDelay = 0;
+  restartStreaming();
+
+  uint64_t total_us = 0;
+  uint64_t worst_us = 0;
+  uint64_t start_us = 0;
+  char line[command::MAX_LINE_LENGTH];
+  char ack[24];
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    for (uint32_t offset = (uint32_t)(i * 1700 % 40000); offset >= 100; offset -= 100) {
+      sim::clock::advance_micros(100);
+      loop();
+    }
+    sim::serial::clear_captured();
+    unsigned id = (unsigned)(i % 1000) + 1;
+    snprintf(line, sizeof(line), "N%u T Q\n", id);
+    snprintf(ack, sizeof(ack), "\"id\": %u}", id);
+    sim::serial::feed(line);
+    uint32_t start = micros();
+    uint32_t pass = start;      // when the pass that replies began
+    loop();
+    while (sim::serial::captured().find(ack) == std::string::npos && micros() - start < 1000000) {
+      sim::clock::advance_micros(100);
+      pass = micros();
+      loop();
+    }
+    uint64_t us = micros() - start;
+    start_us += pass - start;
+    total_us += us;
+    worst_us = us > worst_us ? us : worst_us;
+  }
+  state.counter("avg_ms", (double)total_us / state.iterations() / 1000);
+  state.counter("max_ms", (double)worst_us / 1000);
+  state.counter("start_ms", (double)start_us / state.iterations() / 1000);
+
+  gStreamingStatusEnabled = false;
+  restartStreaming();
+  sim::serial::set_line_rate(0);
+  loop();
+  sim::serial::clear_captured();
+  sim::serial::set_output(sim::serial::output::discard);
+}
+BENCHMARK("command/reply_latency", command_reply_latency);
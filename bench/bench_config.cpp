@@ -0,0 +1,67 @@
+// Cost of saving a setting: the old per-command EEPROM.write() calls against
+// a deferred ConfigStore commit. waits/op counts the calls that blocked on
+// the 3.3 ms EEPROM write, each of which stalls sampling and streaming.
+
+#include "bench.h"
+
+#include <string.h>
+
+#include "EEPROM.h"
+#include "config_store.h"
+#include "sim.h"
+
+struct settings {
+  uint8_t enabled;
+  uint8_t stream;
+  uint16_t delay;
+  uint16_t door[2];
+  uint8_t deadband[8];
+};
+
+// Clear of the firmware's own slots.
+static const uint16_t BASE = 512;
+
+// What T S1 <ms> used to do: three bytes written in place.
+static void config_write_in_place(bench::State &state)
+{
+  uint64_t writes = sim::eeprom::writes();
+  uint64_t waits = sim::eeprom::waits();
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    uint16_t delay = (uint16_t)i;
+    EEPROM.write(BASE, 1);
+    EEPROM.write(BASE + 1, delay);
+    EEPROM.write(BASE + 2, delay >> 8);
+  }
+  state.counter("writes/op", (double)(sim::eeprom::writes() - writes) / state.iterations());
+  state.counter("waits/op", (double)(sim::eeprom::waits() - waits) / state.iterations());
+}
+BENCHMARK("config/write_in_place", config_write_in_place);
+
+static void config_store_commit(bench::State &state)
+{
+  settings s;
+  memset(&s, 0, sizeof(s));
+  storage::ConfigStore store(&s, sizeof(s), 1, BASE, 4);
+  store.load();
+
+  uint64_t writes = sim::eeprom::writes();
+  uint64_t waits = sim::eeprom::waits();
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    s.delay = (uint16_t)i;
+    store.markDirty();
+    sim::clock::advance_micros(storage::ConfigStore::COMMIT_DELAY_MS * 1000UL);
+    while (store.dirty()) {
+      store.poll();
+    }
+  }
+  state.counter("writes/op", (double)(sim::eeprom::writes() - writes) / state.iterations());
+  state.counter("waits/op", (double)(sim::eeprom::waits() - waits) / state.iterations());
+
+  // the last commit has to read back
+  settings loaded;
+  storage::ConfigStore check(&loaded, sizeof(loaded), 1, BASE, 4);
+  if (!check.load() || memcmp(&loaded, &s, sizeof(s)) != 0) {
+    state.fail("committed config does not load back");
+  }
+}
+BENCHMARK("config/store_commit", config_store_commit);
@@ -0,0 +1,58 @@
+// Door motion profiles: cost of one eased step and its error against the
+// same curves in double precision.
+
+#include "bench.h"
+
+#include <math.h>
+
+#include "door_motion.h"
+#include "Servo.h"
+
+static double reference_ease(motion::profile shape, double t)
+{
+  switch (shape) {
+    case motion::profile::TRAPEZOID:
+      if (t < 0.25) {
+        return 8.0 / 3.0 * t * t;
+      }
+      if (t > 0.75) {
+        return 1 - 8.0 / 3.0 * (1 - t) * (1 - t);
+      }
+      return 4.0 / 3.0 * (t - 0.125);
+    case motion::profile::EASE_IN_OUT:
+      return t * t * (3 - 2 * t);
+    default:
+      return t;
+  }
+}
+
+// One op is an ease() and interpolate() of a 1856 us servo span, cycling
+// through the profiles and 0..ONE. max_error_us is the worst pulse error,
+// and the run fails if any profile ever stepped backwards.
+static void door_ease(bench::State &state)
+{
+  const int32_t from = MIN_PULSE_WIDTH;
+  const int32_t to = MAX_PULSE_WIDTH;
+  double worst = 0;
+  bool monotonic = true;
+  int32_t last[3] = { from, from, from };
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    uint8_t shape = i % 3;
+    uint32_t t = (uint32_t)(i / 3 % (motion::ONE + 1));
+    if (t == 0) {
+      last[shape] = from;
+    }
+    int32_t pulse = motion::interpolate(from, to, motion::ease((motion::profile)shape, t));
+    bench::do_not_optimize(pulse);
+
+    double exact = from + (to - from) * reference_ease((motion::profile)shape, (double)t / motion::ONE);
+    worst = fmax(worst, fabs(pulse - exact));
+    monotonic = monotonic && pulse >= last[shape];
+    last[shape] = pulse;
+  }
+  state.counter("max_error_us", worst);
+  if (!monotonic) {
+    state.fail("a profile stepped backwards");
+  }
+}
+BENCHMARK("door/ease", door_ease);
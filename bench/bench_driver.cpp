@@ -0,0 +1,105 @@
+// Per-channel cost of the MAX31855 driver: SPI read + decode, and JSON.
+
+#include "bench.h"
+
+#include "max31855.h"
+#include "sim.h"
+
+using tc = sensor::temperature::thermocouple::max31855::Driver;
+
+static void driver_update(bench::State &state)
+{
+  tc sensor(0, 10);
+  uint64_t frames = sim::max31855::frames_read();
+  uint64_t stale = sim::max31855::stale_frames_read();
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    sensor.update();
+  }
+  bench::do_not_optimize(sensor);
+  state.counter("frames/op", (double)(sim::max31855::frames_read() - frames) / state.iterations());
+  state.counter("stale/op", (double)(sim::max31855::stale_frames_read() - stale) / state.iterations());
+}
+BENCHMARK("driver/update", driver_update);
+
+// A sweep every 10 ms of simulated time, as with T S1 10.
+static void driver_update_every_10ms(bench::State &state)
+{
+  tc sensor(0, 10);
+  uint64_t frames = sim::max31855::frames_read();
+  uint64_t stale = sim::max31855::stale_frames_read();
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    sim::clock::advance_micros(10000);
+    sensor.update();
+  }
+  bench::do_not_optimize(sensor);
+  state.counter("frames/op", (double)(sim::max31855::frames_read() - frames) / state.iterations());
+  state.counter("stale/op", (double)(sim::max31855::stale_frames_read() - stale) / state.iterations());
+}
+BENCHMARK("driver/update_every_10ms", driver_update_every_10ms);
+
+static void driver_to_json(bench::State &state)
+{
+  tc sensor(0, 10);
+  sensor.update();
+
+  sim::heap::reset();
+  uint64_t bytes = 0;
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    String json = sensor.toJson();
+    bytes += json.length();
+  }
+  state.set_bytes_processed(bytes);
+  state.counter("allocs/op", (double)sim::heap::get().allocations / state.iterations());
+  state.counter("peak_heap", (double)sim::heap::get().peak_bytes);
+}
+BENCHMARK("driver/toJson", driver_to_json);
+
+static void driver_print_json(bench::State &state)
+{
+  tc sensor(0, 10);
+  sensor.update();
+
+  sim::serial::set_output(sim::serial::output::discard);
+  uint64_t tx = sim::serial::tx_bytes();
+  sim::heap::reset();
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    sensor.printJson(Serial);
+  }
+  state.set_bytes_processed(sim::serial::tx_bytes() - tx);
+  state.counter("allocs/op", (double)sim::heap::get().allocations / state.iterations());
+  state.counter("peak_heap", (double)sim::heap::get().peak_bytes);
+}
+BENCHMARK("driver/printJson", driver_print_json);
+
+static void driver_to_json_buffer(bench::State &state)
+{
+  tc sensor(0, 10);
+  sensor.update();
+
+  char buffer[tc::JSON_MAX_LENGTH + 1];
+  uint64_t bytes = 0;
+  sim::heap::reset();
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    bytes += sensor.toJson(buffer, sizeof(buffer));
+    bench::do_not_optimize(buffer);
+  }
+  state.set_bytes_processed(bytes);
+  state.counter("allocs/op", (double)sim::heap::get().allocations / state.iterations());
+}
+BENCHMARK("driver/toJson_buffer", driver_to_json_buffer);
+
+// Decode and format cost of one channel: every iteration gets a fresh
+// conversion, which is then printed as JSON.
+static void driver_decode_and_format(bench::State &state)
+{
+  tc sensor(0, 10);
+  bench::NullPrint out;
+  uint64_t bytes = 0;
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    sim::clock::advance_micros(tc::CONVERSION_TIME_US);
+    sensor.update();
+    bytes += sensor.printJson(out);
+  }
+  state.set_bytes_processed(bytes);
+}
+BENCHMARK("driver/decode_and_format", driver_decode_and_format);
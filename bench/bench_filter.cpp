@@ -0,0 +1,56 @@
+// Per sample cost of each channel filter, and of a filtered 8 channel sweep.
+
+#include "bench.h"
+
+#include "filter.h"
+
+using sensor::temperature::Filter;
+using sensor::temperature::filter_mode;
+
+static void filter_add(bench::State &state, filter_mode mode, uint8_t oversampling)
+{
+  Filter f;
+  f.configure(mode, 32, oversampling);
+  int16_t out = 0;
+  uint64_t published = 0;
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    // a noisy ramp with a spike every 16 samples
+    int16_t value = (int16_t)(720 + (i & 7) + ((i & 15) == 0 ? 200 : 0));
+    published += f.add(value, out);
+  }
+  bench::do_not_optimize(out);
+  state.counter("published/op", (double)published / state.iterations());
+}
+
+static void filter_none(bench::State &state) { filter_add(state, filter_mode::NONE, 1); }
+BENCHMARK("filter/none", filter_none);
+
+static void filter_median3(bench::State &state) { filter_add(state, filter_mode::MEDIAN_3, 1); }
+BENCHMARK("filter/median3", filter_median3);
+
+static void filter_median5(bench::State &state) { filter_add(state, filter_mode::MEDIAN_5, 1); }
+BENCHMARK("filter/median5", filter_median5);
+
+static void filter_iir(bench::State &state) { filter_add(state, filter_mode::IIR, 1); }
+BENCHMARK("filter/iir", filter_iir);
+
+static void filter_median5_oversample4(bench::State &state) { filter_add(state, filter_mode::MEDIAN_5, 4); }
+BENCHMARK("filter/median5_oversample4", filter_median5_oversample4);
+
+// The worst case a sweep pays: every channel through a 5 tap median.
+static void filter_sweep(bench::State &state)
+{
+  Filter f[8];
+  for (uint8_t c = 0; c < 8; c++) {
+    f[c].configure(filter_mode::MEDIAN_5, 32, 1);
+  }
+  int16_t out = 0;
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    for (uint8_t c = 0; c < 8; c++) {
+      f[c].add((int16_t)(720 + c + (i & 7)), out);
+    }
+  }
+  bench::do_not_optimize(out);
+  state.counter("bytes/channel", (double)sizeof(Filter));
+}
+BENCHMARK("filter/sweep_8ch_median5", filter_sweep);
@@ -0,0 +1,32 @@
+// Per sample cost of the channel history and the cost of an H W dump.
+
+#include "bench.h"
+
+#include "history.h"
+
+using history = sensor::temperature::History<16, fixed::QUARTER_DEGREES>;
+
+static void history_add(bench::State &state)
+{
+  history h;
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    h.add((uint32_t)i * 100, (int16_t)(720 + (i & 15)));
+  }
+  bench::do_not_optimize(h);
+}
+BENCHMARK("history/add", history_add);
+
+static void history_print_window(bench::State &state)
+{
+  history h;
+  for (uint16_t i = 0; i < 16; i++) {
+    h.add(i * 100, 720 + i);
+  }
+  bench::NullPrint out;
+  uint64_t bytes = 0;
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    bytes += h.printWindow(out, 0, 1600);
+  }
+  state.set_bytes_processed(bytes);
+}
+BENCHMARK("history/printWindow", history_print_window);
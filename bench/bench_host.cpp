@@ -0,0 +1,121 @@
+// Host side stream decoding (host/stream_decoder.h). The input is what the
+// firmware itself streams: status frames for every channel of the board,
+// recorded from the sim for CAPTURE_PERIODS conversion periods and fed to
+// the decoder in 64 byte reads, as a serial port hands them over. An op is
+// one pass over the whole capture.
+
+#include "bench.h"
+
+#include <chrono>
+#include <string>
+
+#include "Arduino.h"
+#include "max31855.h"
+#include "sim.h"
+#include "stream_decoder.h"
+
+using tc = sensor::temperature::thermocouple::max31855::Driver;
+
+extern bool gStreamingTemperatureEnabled;
+extern bool gStreamingStatusEnabled;
+extern bool gStreamingBinary;
+extern uint16_t gStreamingDelay;
+extern void restartStreaming();
+
+static const uint16_t CAPTURE_PERIODS = 200;
+static const size_t READ_SIZE = 64;
+
+static std::string record_stream(bool binary)
+{
+  gStreamingTemperatureEnabled = false;
+  gStreamingStatusEnabled = true;
+  gStreamingBinary = binary;
+  gStreamingDelay = 0;
+  restartStreaming();
+  // the first period flushes out what was streaming before
+  for (uint16_t i = 0; i <= CAPTURE_PERIODS; i++) {
+    if (i == 1) {
+      sim::serial::set_output(sim::serial::output::capture);
+      sim::serial::clear_captured();
+    }
+    for (uint8_t pass = 0; pass < 10; pass++) {
+      sim::clock::advance_micros(tc::CONVERSION_TIME_US / 10);
+      loop();
+    }
+  }
+  std::string stream = sim::serial::captured();
+  // Frames go out in pieces across passes; start and end on whole ones so
+  // that passes over the capture line up.
+  char end = binary ? '\0' : '\n';
+  stream.resize(stream.find_last_of(end) + 1);
+  stream.erase(0, stream.find(end) + 1);
+  sim::serial::clear_captured();
+  sim::serial::set_output(sim::serial::output::discard);
+  gStreamingStatusEnabled = false;
+  gStreamingBinary = false;
+  restartStreaming();
+  return stream;
+}
+
+class Counter : public host::Listener {
+public:
+  uint64_t records = 0;
+
+  void frame(const host::frame &f) override
+  {
+    records += f.count;
+    bench::do_not_optimize(f.records[0].corrected);
+  }
+};
+
+template <typename Decoder>
+static void run_decoder(bench::State &state, const std::string &stream, size_t read_size)
+{
+  Counter counter;
+  static Decoder *decoder = NULL;     // large; built once per run, off the stack
+  delete decoder;
+  decoder = new Decoder(counter);
+
+  const uint8_t *data = (const uint8_t *)stream.data();
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    for (size_t offset = 0; offset < stream.size(); offset += read_size) {
+      size_t length = stream.size() - offset < read_size ? stream.size() - offset : read_size;
+      decoder->feed(data + offset, length);
+    }
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  const host::decoder_stats &stats = decoder->stats();
+  state.set_bytes_processed(stats.bytes);
+  state.counter("frames/op", (double)stats.frames / state.iterations());
+  state.counter("frames/s", elapsed.count() > 0 ? stats.frames / elapsed.count() : 0);
+  state.counter("malformed", (double)stats.malformed);
+  if (stats.malformed) {
+    state.fail("firmware output did not decode");
+  }
+}
+
+static void host_decode_json(bench::State &state)
+{
+  static const std::string stream = record_stream(false);
+  run_decoder<host::JsonDecoder>(state, stream, READ_SIZE);
+}
+BENCHMARK("host/decode_json", host_decode_json);
+
+// Binary streams send temperatures, door and controller as three frames
+// per period, each counted.
+static void host_decode_binary(bench::State &state)
+{
+  static const std::string stream = record_stream(true);
+  run_decoder<host::BinaryDecoder>(state, stream, READ_SIZE);
+}
+BENCHMARK("host/decode_binary", host_decode_binary);
+
+// A byte at a time, as from a non-blocking read on a slow port.
+static void host_decode_json_bytewise(bench::State &state)
+{
+  static const std::string stream = record_stream(false);
+  run_decoder<host::JsonDecoder>(state, stream, 1);
+}
+BENCHMARK("host/decode_json_bytewise", host_decode_json_bytewise);
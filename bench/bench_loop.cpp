@@ -0,0 +1,167 @@
+// One streaming iteration of the firmware's loop(), serial output included,
+// for every channel of the board (BENCH_CHANNELS). Frames only carry new
+// readings, so in the streaming cases an op is one conversion period: ten
+// passes of loop() 10 ms of simulated time apart, with one sweep, its
+// decode and the frame among them.
+
+#include "bench.h"
+
+#include "Arduino.h"
+#include "max31855.h"
+#include "sim.h"
+
+using tc = sensor::temperature::thermocouple::max31855::Driver;
+
+extern bool gStreamingTemperatureEnabled;
+extern bool gStreamingStatusEnabled;
+extern bool gStreamingBinary;
+extern uint16_t gStreamingDelay;
+extern bool gStreamingChangesOnly;
+extern uint16_t gKeepAliveDelay;
+extern void restartStreaming();
+
+static void run_loop(bench::State &state, bool per_conversion = false)
+{
+  const uint8_t passes = per_conversion ? 10 : 1;
+  const uint32_t pass_us = per_conversion ? tc::CONVERSION_TIME_US / passes : 0;
+  uint64_t tx = sim::serial::tx_bytes();
+  sim::heap::reset();
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    for (uint8_t pass = 0; pass < passes; pass++) {
+      sim::clock::advance_micros(pass_us);
+      loop();
+    }
+  }
+  state.set_bytes_processed(sim::serial::tx_bytes() - tx);
+  state.counter("allocs/op", (double)sim::heap::get().allocations / state.iterations());
+  state.counter("peak_heap", (double)sim::heap::get().peak_bytes);
+}
+
+static void loop_stream_temperature(bench::State &state)
+{
+  gStreamingTemperatureEnabled = true;
+  gStreamingStatusEnabled = false;
+  gStreamingDelay = 0;
+  restartStreaming();
+  run_loop(state, true);
+  gStreamingTemperatureEnabled = false;
+  restartStreaming();
+}
+BENCHMARK("loop/stream_temperature", loop_stream_temperature);
+
+static void loop_stream_status(bench::State &state)
+{
+  gStreamingTemperatureEnabled = false;
+  gStreamingStatusEnabled = true;
+  gStreamingDelay = 0;
+  restartStreaming();
+  run_loop(state, true);
+  gStreamingStatusEnabled = false;
+  restartStreaming();
+}
+BENCHMARK("loop/stream_status", loop_stream_status);
+
+static void loop_stream_binary(bench::State &state)
+{
+  gStreamingTemperatureEnabled = false;
+  gStreamingStatusEnabled = true;
+  gStreamingBinary = true;
+  gStreamingDelay = 0;
+  restartStreaming();
+  run_loop(state, true);
+  gStreamingStatusEnabled = false;
+  gStreamingBinary = false;
+  restartStreaming();
+}
+BENCHMARK("loop/stream_status_binary", loop_stream_binary);
+
+// Change-only streaming with every channel holding steady except channel 0,
+// which moves a degree per conversion. Output is reported per chip read,
+// where full frames cost one channel record (about 90 bytes) per read.
+static void loop_stream_changes_only(bench::State &state)
+{
+  gStreamingTemperatureEnabled = true;
+  gStreamingStatusEnabled = false;
+  gStreamingChangesOnly = true;
+  gKeepAliveDelay = 10000;
+  gStreamingDelay = 0;
+  restartStreaming();
+  uint64_t tx = sim::serial::tx_bytes();
+  uint64_t reads = sim::max31855::frames_read();
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    sim::max31855::set_temperature(10, 180.25 + sim::max31855::frames_read(10) % 100, 24.0625);
+    loop();
+  }
+  state.set_bytes_processed(sim::serial::tx_bytes() - tx);
+  state.counter("bytes/read", (double)(sim::serial::tx_bytes() - tx) / (sim::max31855::frames_read() - reads));
+  sim::max31855::set_temperature(10, 180.25, 24.0625);
+  gStreamingChangesOnly = false;
+  gStreamingTemperatureEnabled = false;
+  restartStreaming();
+}
+BENCHMARK("loop/stream_changes_only", loop_stream_changes_only);
+
+// Cost of a loop() pass between samples, which bounds command latency.
+static void loop_idle_while_streaming(bench::State &state)
+{
+  gStreamingTemperatureEnabled = true;
+  gStreamingStatusEnabled = false;
+  gStreamingDelay = 60000;
+  restartStreaming();
+  loop();
+  run_loop(state);
+  gStreamingTemperatureEnabled = false;
+  restartStreaming();
+}
+BENCHMARK("loop/idle_while_streaming", loop_idle_while_streaming);
+
+// Status streaming every 10 ms over a real 115200 baud link, which needs
+// about 39 ms for a 4 channel JSON frame. Status frames carry the door and
+// controller every period even without new readings, so the emitter should
+// keep the link busy without loop() ever blocking on it: tx_waits counts
+// writes that found the TX buffer full and must stay 0, and bytes/s
+// should sit at the line rate.
+extern uint32_t gFramesCoalesced;
+extern uint32_t gFramesDropped;
+
+static void stream_slow_link(bench::State &state, uint16_t delay)
+{
+  gStreamingTemperatureEnabled = false;
+  gStreamingStatusEnabled = true;
+  gStreamingDelay = delay;
+  restartStreaming();
+  sim::serial::set_line_rate(115200);
+  uint64_t waits = sim::serial::tx_waits();
+  uint32_t coalesced = gFramesCoalesced;
+  uint32_t dropped = gFramesDropped;
+  run_loop(state);
+  state.counter("tx_waits", (double)(sim::serial::tx_waits() - waits));
+  if (sim::serial::tx_waits() != waits) {
+    state.fail("loop() blocked on the TX buffer");
+  }
+  state.counter("coalesced", (double)(gFramesCoalesced - coalesced));
+  state.counter("dropped", (double)(gFramesDropped - dropped));
+  gStreamingStatusEnabled = false;
+  restartStreaming();
+  // let the frame in flight finish so the next case starts idle
+  sim::serial::set_line_rate(0);
+  loop();
+}
+
+static void loop_stream_slow_link(bench::State &state)
+{
+  stream_slow_link(state, 10);
+}
+BENCHMARK("loop/stream_slow_link", loop_stream_slow_link);
+
+// The same with a streaming delay of 0: frames go back to back as fast as
+// the link drains, and no period is ever coalesced or dropped.
+static void loop_stream_unthrottled(bench::State &state)
+{
+  uint32_t dropped = gFramesDropped;
+  stream_slow_link(state, 0);
+  if (gFramesDropped != dropped) {
+    state.fail("frames dropped with no streaming period");
+  }
+}
+BENCHMARK("loop/stream_unthrottled", loop_stream_unthrottled);
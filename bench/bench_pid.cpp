@@ -0,0 +1,93 @@
+// Door PID: cost of a control step, how far the fixed point version strays
+// from the same controller in double precision, and how it holds a simple
+// oven model.
+
+#include "bench.h"
+
+#include <math.h>
+
+#include "pid.h"
+
+static const uint16_t PERIOD_MS = 100;
+
+// The controller of pid.h without the fixed point: same clamps, same
+// anti-windup, outputs in permille.
+struct reference_pid {
+  double kp, ki, kd;
+  double integral;
+  double last;
+  bool primed;
+
+  reference_pid(double p, double i, double d) : kp(p), ki(i), kd(d), integral(0), last(0), primed(false) {}
+
+  double update(double setpoint, double measured)
+  {
+    double dt = PERIOD_MS / 1000.0;
+    double error = fmax(-256, fmin(256, measured - setpoint));
+    double change = primed ? fmax(-256, fmin(256, measured - last)) : 0;
+    last = measured;
+    primed = true;
+    double p = fmax(-2000, fmin(2000, kp * error));
+    double d = fmax(-2000, fmin(2000, kd * change / dt));
+    integral = fmax(0, fmin(1000, integral + ki * error * dt));
+    return fmax(0, fmin(1000, p + integral + d));
+  }
+};
+
+// One op is an update() on a measurement that wanders around the setpoint.
+// max_error_permille is the worst output difference from the reference.
+static void control_pid_update(bench::State &state)
+{
+  control::Pid pid;
+  pid.setGains(20000, 2000, 5000, PERIOD_MS);
+  pid.reset(0);
+  reference_pid reference(20.0, 2.0, 5.0);
+
+  int16_t setpoint = 200 * 4;
+  int16_t measured = setpoint;
+  uint32_t seed = 1;
+  double worst = 0;
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    seed = seed * 1103515245 + 12345;
+    measured += (int16_t)((seed >> 16) % 9) - 4;
+    if (measured < setpoint - 400 || measured > setpoint + 400) {
+      measured = setpoint;
+    }
+    int16_t out = pid.update(setpoint, measured);
+    bench::do_not_optimize(out);
+    double error = fabs(out - reference.update(setpoint / 4.0, measured / 4.0));
+    worst = error > worst ? error : worst;
+  }
+  state.counter("max_error_permille", worst);
+}
+BENCHMARK("control/pid_update", control_pid_update);
+
+// An oven that heats at 2 C/s at full power and loses heat through the
+// door in proportion to how far it is open, read at the chip's 0.25 C.
+// One op is 100 ms of simulated time, from 25 C towards a 150 C setpoint;
+// overshoot_c and error_c (the worst deviation over the last half) show
+// whether the loop settles.
+static void control_pid_oven(bench::State &state)
+{
+  control::Pid pid;
+  pid.setGains(50000, 1000, 20000, PERIOD_MS);
+  pid.reset(0);
+
+  const double setpoint = 150;
+  double oven = 25;
+  double overshoot = 0;
+  double settled = 0;
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    int16_t reading = (int16_t)lround(oven * 4);
+    int16_t out = pid.update((int16_t)(setpoint * 4), reading);
+    double dt = PERIOD_MS / 1000.0;
+    oven += (2.0 - (oven - 25) * (0.002 + 0.03 * out / 1000.0)) * dt;
+    overshoot = fmax(overshoot, oven - setpoint);
+    if (i > state.iterations() / 2) {
+      settled = fmax(settled, fabs(oven - setpoint));
+    }
+  }
+  state.counter("overshoot_c", overshoot);
+  state.counter("error_c", settled);
+}
+BENCHMARK("control/pid_oven", control_pid_oven);
@@ -0,0 +1,124 @@
+// Cost of the sampling interrupt: reading the chips and handing the raw
+// frames to loop().
+
+#include "bench.h"
+
+#include "sensor_bank.h"
+#include "sample_planner.h"
+#include "spsc_queue.h"
+
+using tc = sensor::temperature::thermocouple::max31855::Driver;
+
+struct frame {
+  uint8_t channel;
+  uint32_t frame;
+  uint32_t time;
+};
+
+static void sampler_queue_push_pop(bench::State &state)
+{
+  SpscQueue<frame, 16> queue;
+  frame in = { 0, 0x0b400190, 0 };
+  frame out;
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    in.time = (uint32_t)i;
+    queue.push(in);
+    queue.pop(out);
+    bench::do_not_optimize(out);
+  }
+}
+BENCHMARK("sampler/queue_push_pop", sampler_queue_push_pop);
+
+// One full sweep of the board from the sampling interrupt: the compile time
+// bank against a loop over Drivers with runtime chip selects. On the host
+// both toggle chip selects through digitalWrite(), so this shows the loop
+// and branch overhead only; on the ATmega328P the bank's chip selects are
+// single instructions as well.
+#ifdef HAS_8_CHANNELS
+using bench_bank = sensor::temperature::thermocouple::max31855::Bank<10, 9, 8, 7, 6, 5, 4, 3>;
+#else
+using bench_bank = sensor::temperature::thermocouple::max31855::Bank<10, 9, 8, 7>;
+#endif
+
+static void sampler_bank_sweep(bench::State &state)
+{
+  bench_bank bank;
+  uint32_t frames[bench_bank::SIZE];
+  uint32_t now = 0;
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    now += tc::CONVERSION_TIME_US;
+    bank.sweep(now, frames);
+    bench::do_not_optimize(frames);
+  }
+}
+BENCHMARK("sampler/bank_sweep", sampler_bank_sweep);
+
+// The same sweep with only three thermocouples wired, as channel discovery
+// leaves it: the other chips are not read at all.
+static void sampler_bank_sweep_three_live(bench::State &state)
+{
+  bench_bank bank;
+  uint32_t frames[bench_bank::SIZE];
+  uint32_t now = 0;
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    now += tc::CONVERSION_TIME_US;
+    bank.sweep(now, frames, 0x07);
+    bench::do_not_optimize(frames);
+  }
+}
+BENCHMARK("sampler/bank_sweep_three_live", sampler_bank_sweep_three_live);
+
+// Channel 0 at 10 Hz and the rest at 0.2 Hz, planned per conversion: most
+// sweeps read one chip. reads/op is the chips read per conversion, against
+// BENCH_CHANNELS for a full sweep.
+static void sampler_planned_sweep(bench::State &state)
+{
+  bench_bank bank;
+  sampling::Planner<bench_bank::SIZE> planner;
+  for (uint8_t c = 1; c < bench_bank::SIZE; c++) {
+    planner.setPeriod(c, 5000);
+  }
+  uint32_t frames[bench_bank::SIZE];
+  uint32_t now = 0;
+  uint32_t ms = millis();   // setPeriod() makes the channels due from now
+  uint64_t reads = 0;
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    now += tc::CONVERSION_TIME_US;
+    ms += tc::CONVERSION_TIME_US / 1000;
+    uint8_t due = planner.due(ms, bench_bank::ALL);
+    if (due) {
+      bank.sweep(now, frames, due);
+      reads += __builtin_popcount(due);
+    }
+    bench::do_not_optimize(frames);
+  }
+  state.counter("reads/op", (double)reads / state.iterations());
+}
+BENCHMARK("sampler/planned_sweep", sampler_planned_sweep);
+
+static void sampler_driver_sweep(bench::State &state)
+{
+  static const int8_t pins[] = { 10, 9, 8, 7, 6, 5, 4, 3 };
+  tc drivers[BENCH_CHANNELS] = {
+    tc(0, pins[0]), tc(1, pins[1]), tc(2, pins[2]), tc(3, pins[3])
+#ifdef HAS_8_CHANNELS
+    , tc(4, pins[4]), tc(5, pins[5]), tc(6, pins[6]), tc(7, pins[7])
+#endif
+  };
+  bool enabled[BENCH_CHANNELS];
+  for (uint8_t c = 0; c < BENCH_CHANNELS; c++) {
+    enabled[c] = true;
+  }
+  uint32_t frames[BENCH_CHANNELS];
+  uint32_t now = 0;
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    now += tc::CONVERSION_TIME_US;
+    for (uint8_t c = 0; c < BENCH_CHANNELS; c++) {
+      if (enabled[c]) {
+        drivers[c].sample(now, frames[c]);
+      }
+    }
+    bench::do_not_optimize(frames);
+  }
+}
+BENCHMARK("sampler/driver_sweep", sampler_driver_sweep);
@@ -0,0 +1,185 @@
+// Type K linearization: cost per channel, and its accuracy against the NIST
+// ITS-90 reference table and reference function. A run outside the
+// tolerances below fails.
+
+#include "bench.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "type_k.h"
+#include "type_k_reference.h"
+
+namespace type_k = sensor::temperature::thermocouple::type_k;
+
+// The published table is rounded to 1 uV, and the firmware's table to 1 uV
+// every TABLE_STEP C, with linear interpolation in between.
+static const int32_t EMF_TOLERANCE_UV = 2;
+// The chip's 0.25 C steps and the 0.0625 C output, with some margin.
+static const double LINEARIZE_TOLERANCE_C = 0.5;
+
+// NIST ITS-90 Type K reference table, uV at every 100 C.
+static const struct {
+  int16_t temperature;
+  int32_t emf;
+} nist_table[] = {
+  { -200, -5891 }, { -100, -3554 }, {    0,     0 }, {  100,  4096 },
+  {  200,  8138 }, {  300, 12209 }, {  400, 16397 }, {  500, 20644 },
+  {  600, 24905 }, {  700, 29129 }, {  800, 33275 }, {  900, 37326 },
+  { 1000, 41276 }, { 1100, 45119 }, { 1200, 48838 }, { 1300, 52410 },
+  { 1372, 54886 }
+};
+
+// The reference function in full double precision, independent of the
+// firmware's compile time version.
+static double nist_uv(double t)
+{
+  static const double negative[] = {
+    0.000000000000E+00,  0.394501280250E-01,  0.236223735980E-04,
+   -0.328589067840E-06, -0.499048287770E-08, -0.675090591730E-10,
+   -0.574103274280E-12, -0.310888728940E-14, -0.104516093650E-16,
+   -0.198892668780E-19, -0.163226974860E-22
+  };
+  static const double positive[] = {
+   -0.176004136860E-01,  0.389212049750E-01,  0.185587700320E-04,
+   -0.994575928740E-07,  0.318409457190E-09, -0.560728448890E-12,
+    0.560750590590E-15, -0.320207200030E-18,  0.971511471520E-22,
+   -0.121047212750E-25
+  };
+  const double *c = t < 0 ? negative : positive;
+  int n = t < 0 ? 11 : 10;
+  double mv = 0;
+  for (int i = n - 1; i >= 0; i--) {
+    mv = mv * t + c[i];
+  }
+  if (t >= 0) {
+    mv += 0.118597600000E+00 * exp(-0.118343200000E-03 * (t - 0.126968600000E+03) * (t - 0.126968600000E+03));
+  }
+  return mv * 1000.0;
+}
+
+// What the MAX31855 reports for a hot junction at hot and the chip at cold:
+// T = T_junction + V / 41.276 uV/C, quantized to its 0.25 C and 0.0625 C
+// steps.
+static void chip_reading(double hot, double cold, int16_t &thermocouple, int16_t &junction)
+{
+  junction = (int16_t)lround(cold * 16);
+  double reported = cold + (nist_uv(hot) - nist_uv(cold)) / 41.276;
+  thermocouple = (int16_t)lround(reported * 4);
+}
+
+struct grid_point {
+  int16_t thermocouple;
+  int16_t junction;
+  float hot;
+};
+
+// Hot junction temperatures -200..1372 C at board temperatures -40..125 C,
+// as the chip reports them.
+static const std::vector<grid_point> &grid()
+{
+  static std::vector<grid_point> points;
+  if (points.empty()) {
+    for (int cold = -40; cold <= 125; cold += 5) {
+      for (int hot = -200; hot <= 1372; hot++) {
+        grid_point p;
+        chip_reading(hot, cold, p.thermocouple, p.junction);
+        p.hot = hot;
+        points.push_back(p);
+      }
+    }
+  }
+  return points;
+}
+
+// One op is a linearize() call on a grid point. max_error_c is the worst
+// difference from the true hot junction temperature, including the chip's
+// own quantization; uncorrected_c is the same for the chip's raw value.
+static void type_k_linearize(bench::State &state)
+{
+  const std::vector<grid_point> &points = grid();
+  double worst = 0;
+  double worst_raw = 0;
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    const grid_point &p = points[i % points.size()];
+    int16_t corrected = type_k::linearize(p.thermocouple, p.junction);
+    bench::do_not_optimize(corrected);
+
+    double error = fabs(corrected / 16.0 - p.hot);
+    double raw = fabs(p.thermocouple / 4.0 - p.hot);
+    worst = error > worst ? error : worst;
+    worst_raw = raw > worst_raw ? raw : worst_raw;
+  }
+  state.counter("max_error_c", worst);
+  state.counter("uncorrected_c", worst_raw);
+  if (worst > LINEARIZE_TOLERANCE_C) {
+    state.fail("corrected temperature outside tolerance");
+  }
+}
+BENCHMARK("type_k/linearize", type_k_linearize);
+
+// emf() against the published table; one op is a lookup.
+static void type_k_emf(bench::State &state)
+{
+  const uint8_t points = sizeof(nist_table) / sizeof(nist_table[0]);
+  int32_t worst = 0;
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    int32_t emf = type_k::emf(nist_table[i % points].temperature * 16);
+    bench::do_not_optimize(emf);
+    int32_t error = labs(emf - nist_table[i % points].emf);
+    worst = error > worst ? error : worst;
+  }
+  state.counter("max_error_uv", worst);
+  if (worst > EMF_TOLERANCE_UV) {
+    state.fail("emf() outside tolerance of the NIST table");
+  }
+}
+BENCHMARK("type_k/emf", type_k_emf);
+
+// The table as avr-gcc builds it: double is 32 bits there, so type_k.cpp's
+// constexpr reference function runs in float. One op evaluates an entry in
+// float. max_diff_uv is the worst difference from the entries the native
+// build folded in double, max_error_uv the worst error of the float table,
+// interpolated like emf() does, against the published NIST table. A table
+// that is not strictly increasing would break temperature()'s search.
+static void type_k_float_table(bench::State &state)
+{
+  const uint16_t size = (type_k::TABLE_MAX - type_k::TABLE_MIN) / type_k::TABLE_STEP + 1;
+  std::vector<int32_t> table(size);
+  int32_t worst_diff = 0;
+  bool increasing = true;
+  for (uint64_t i = 0; i < state.iterations(); i++) {
+    uint16_t n = i % size;
+    int16_t t = type_k::TABLE_MIN + n * type_k::TABLE_STEP;
+    int32_t entry = type_k::reference::entry<float>(t) + type_k::reference::EMF_OFFSET;
+    bench::do_not_optimize(entry);
+    table[n] = entry;
+    if (n > 0 && entry <= table[n - 1]) {
+      increasing = false;
+    }
+    int32_t diff = labs(entry - type_k::emf(t * 16));
+    worst_diff = diff > worst_diff ? diff : worst_diff;
+  }
+
+  double worst = 0;
+  if (state.iterations() >= size) {
+    for (uint8_t i = 0; i < sizeof(nist_table) / sizeof(nist_table[0]); i++) {
+      double offset = (double)(nist_table[i].temperature - type_k::TABLE_MIN) / type_k::TABLE_STEP;
+      uint16_t n = (uint16_t)offset;
+      double emf = n + 1 < size ? table[n] + (table[n + 1] - table[n]) * (offset - n) : table[n];
+      double error = fabs(emf - nist_table[i].emf);
+      worst = error > worst ? error : worst;
+    }
+  }
+  state.counter("max_diff_uv", worst_diff);
+  state.counter("max_error_uv", worst);
+  if (!increasing) {
+    state.fail("float table is not increasing");
+  }
+  if (worst_diff > 1 || worst > EMF_TOLERANCE_UV) {
+    state.fail("float table outside tolerance");
+  }
+}
+BENCHMARK("type_k/float_table", type_k_float_table);
@@ -0,0 +1,271 @@
+#include "capture.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+
+  uint64_t now_us()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+  }
+
+  void sleep_until(uint64_t when_us)
+  {
+    uint64_t now = now_us();
+    if (when_us <= now) {
+      return;
+    }
+    uint64_t wait = when_us - now;
+    struct timespec ts = { (time_t)(wait / 1000000), (long)(wait % 1000000) * 1000 };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+  }
+
+  speed_t baudConstant(long baud)
+  {
+    switch (baud) {
+      case 9600: return B9600;
+      case 19200: return B19200;
+      case 38400: return B38400;
+      case 57600: return B57600;
+      case 115200: return B115200;
+      case 230400: return B230400;
+      case 460800: return B460800;
+      case 500000: return B500000;
+      case 1000000: return B1000000;
+      default: return B0;
+    }
+  }
+
+  bool makeRaw(int fd, long baud)
+  {
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0) {
+      return errno == ENOTTY;   // a plain file or pipe
+    }
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+    if (baud != 0) {
+      speed_t speed = baudConstant(baud);
+      if (speed == B0) {
+        errno = EINVAL;
+        return false;
+      }
+      cfsetispeed(&tio, speed);
+      cfsetospeed(&tio, speed);
+    }
+    return tcsetattr(fd, TCSANOW, &tio) == 0;
+  }
+
+  bool writeAll(int fd, const uint8_t *data, size_t length)
+  {
+    while (length > 0) {
+      ssize_t n = ::write(fd, data, length);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        if (errno == EAGAIN) {
+          struct pollfd p = { fd, POLLOUT, 0 };
+          poll(&p, 1, 100);
+          continue;
+        }
+        return false;
+      }
+      data += n;
+      length -= (size_t)n;
+    }
+    return true;
+  }
+};
+
+bool host::CaptureWriter::open(const char *path)
+{
+  close();
+  _file = strcmp(path, "-") == 0 ? stdout : fopen(path, "wb");
+  if (!_file) {
+    return false;
+  }
+  return fwrite(CAPTURE_MAGIC, 1, 8, _file) == 8;
+}
+
+bool host::CaptureWriter::write(uint32_t delta_us, const uint8_t *data, size_t length)
+{
+  while (length > 0) {
+    uint16_t n = length > MAX_CHUNK ? MAX_CHUNK : (uint16_t)length;
+    uint8_t header[6] = {
+      (uint8_t)delta_us, (uint8_t)(delta_us >> 8), (uint8_t)(delta_us >> 16), (uint8_t)(delta_us >> 24),
+      (uint8_t)n, (uint8_t)(n >> 8)
+    };
+    if (fwrite(header, 1, sizeof(header), _file) != sizeof(header) || fwrite(data, 1, n, _file) != n) {
+      return false;
+    }
+    data += n;
+    length -= n;
+    delta_us = 0;
+  }
+  return fflush(_file) == 0;
+}
+
+bool host::CaptureWriter::close()
+{
+  bool ok = true;
+  if (_file) {
+    ok = _file == stdout ? fflush(_file) == 0 : fclose(_file) == 0;
+    _file = NULL;
+  }
+  return ok;
+}
+
+bool host::CaptureReader::open(const char *path)
+{
+  close();
+  _file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+  if (!_file) {
+    return false;
+  }
+  char magic[8];
+  if (fread(magic, 1, 8, _file) != 8 || memcmp(magic, CAPTURE_MAGIC, 8) != 0) {
+    close();
+    errno = EINVAL;
+    return false;
+  }
+  return true;
+}
+
+bool host::CaptureReader::next(uint32_t &delta_us, const uint8_t *&data, size_t &length)
+{
+  uint8_t header[6];
+  if (!_file || fread(header, 1, sizeof(header), _file) != sizeof(header)) {
+    return false;
+  }
+  delta_us = (uint32_t)header[0] | (uint32_t)header[1] << 8 | (uint32_t)header[2] << 16 | (uint32_t)header[3] << 24;
+  length = (size_t)(header[4] | header[5] << 8);
+  if (length > MAX_CHUNK || fread(_chunk, 1, length, _file) != length) {
+    return false;
+  }
+  data = _chunk;
+  return true;
+}
+
+void host::CaptureReader::close()
+{
+  if (_file && _file != stdin) {
+    fclose(_file);
+  }
+  _file = NULL;
+}
+
+int host::open_serial(const char *path, long baud)
+{
+  int fd = ::open(path, O_RDWR | O_NOCTTY);
+  if (fd < 0) {
+    return -1;
+  }
+  if (!makeRaw(fd, baud)) {
+    int saved = errno;
+    ::close(fd);
+    errno = saved;
+    return -1;
+  }
+  return fd;
+}
+
+int host::open_pty(char *name, size_t size)
+{
+  int fd = posix_openpt(O_RDWR | O_NOCTTY);
+  if (fd < 0) {
+    return -1;
+  }
+  const char *slave = NULL;
+  if (grantpt(fd) != 0 || unlockpt(fd) != 0 || !(slave = ptsname(fd)) || strlen(slave) >= size) {
+    int saved = slave ? ENAMETOOLONG : errno;
+    ::close(fd);
+    errno = saved;
+    return -1;
+  }
+  strcpy(name, slave);
+
+  // The slave side is what the reader opens; make it raw so line endings
+  // and control bytes in binary frames go through untouched.
+  int s = ::open(name, O_RDWR | O_NOCTTY);
+  if (s >= 0) {
+    makeRaw(s, 0);
+    ::close(s);
+  }
+  return fd;
+}
+
+bool host::record_port(int fd, CaptureWriter &capture, uint32_t duration_ms, volatile bool &stop)
+{
+  uint8_t buffer[MAX_CHUNK];
+  uint64_t start = now_us();
+  uint64_t last = start;
+  while (!stop) {
+    int timeout = -1;
+    if (duration_ms != 0) {
+      uint64_t elapsed_ms = (now_us() - start) / 1000;
+      if (elapsed_ms >= duration_ms) {
+        break;
+      }
+      timeout = (int)(duration_ms - elapsed_ms);
+    }
+    struct pollfd p = { fd, POLLIN, 0 };
+    int ready = poll(&p, 1, timeout);
+    if (ready < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    if (ready == 0) {
+      continue;
+    }
+    ssize_t n = read(fd, buffer, sizeof(buffer));
+    if (n < 0) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+      return errno == EIO;    // the other end of a pty closed
+    }
+    if (n == 0) {
+      break;
+    }
+    uint64_t now = now_us();
+    uint64_t delta = now - last;
+    last = now;
+    if (!capture.write(delta > 0xffffffffULL ? 0xffffffffUL : (uint32_t)delta, buffer, (size_t)n)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool host::replay_capture(CaptureReader &capture, int fd, double speed, volatile bool &stop)
+{
+  uint32_t delta_us;
+  const uint8_t *data;
+  size_t length;
+  uint64_t due = now_us();
+  while (!stop && capture.next(delta_us, data, length)) {
+    if (speed > 0) {
+      due += (uint64_t)(delta_us / speed);
+      sleep_until(due);
+    }
+    if (!writeAll(fd, data, length)) {
+      return false;
+    }
+  }
+  return true;
+}
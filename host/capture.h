@@ -0,0 +1,68 @@
+#ifndef _GGH_HOST_CAPTURE_H_
+#define _GGH_HOST_CAPTURE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Raw serial captures. A capture file is the 8 byte magic "MAXCAP01" and
+// then one chunk per read from the port:
+//
+//   delta_us u32 | length u16 | bytes
+//
+// delta_us is the time since the previous chunk, so a replay can keep the
+// original pacing. Multi-byte fields are little endian, as on the wire.
+namespace host {
+
+  static const char CAPTURE_MAGIC[] = "MAXCAP01";
+  static const size_t MAX_CHUNK = 4096;
+
+  class CaptureWriter {
+  public:
+    CaptureWriter() : _file(NULL) {}
+    ~CaptureWriter() { close(); }
+
+    // "-" writes to stdout.
+    bool open(const char *path);
+    bool write(uint32_t delta_us, const uint8_t *data, size_t length);
+    bool close();
+
+  private:
+    FILE *_file;
+  };
+
+  class CaptureReader {
+  public:
+    CaptureReader() : _file(NULL) {}
+    ~CaptureReader() { close(); }
+
+    // "-" reads from stdin. Fails if the magic is missing.
+    bool open(const char *path);
+    // The next chunk, valid until the next call. False at the end of the
+    // file or on a truncated chunk.
+    bool next(uint32_t &delta_us, const uint8_t *&data, size_t &length);
+    void close();
+
+  private:
+    FILE *_file;
+    uint8_t _chunk[MAX_CHUNK];
+  };
+
+  // Opens a serial port or pty in raw mode. baud 0 leaves the speed alone,
+  // which is what a pty wants. Returns -1 with errno set on failure.
+  int open_serial(const char *path, long baud);
+
+  // Opens a new pty master in raw mode and writes the slave's path to
+  // name. Returns -1 with errno set on failure.
+  int open_pty(char *name, size_t size);
+
+  // Copies everything read from fd into the capture until the end of the
+  // input, stop becomes true, or duration_ms passes (0 for no limit).
+  bool record_port(int fd, CaptureWriter &capture, uint32_t duration_ms, volatile bool &stop);
+
+  // Writes the capture to fd. speed 1 keeps the captured pacing, 10 plays
+  // ten times faster and 0 writes as fast as fd takes it.
+  bool replay_capture(CaptureReader &capture, int fd, double speed, volatile bool &stop);
+};
+
+#endif // _GGH_HOST_CAPTURE_H_
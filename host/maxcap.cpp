@@ -0,0 +1,324 @@
+// maxcap: records, replays and decodes serial captures of the board.
+//
+//   maxcap record <port|-> <capture> [-b baud] [-t seconds]
+//   maxcap replay <capture> [port|pty|-] [-s speed]
+//   maxcap decode <capture|-> [-B] [-r] [-q]
+//
+// record copies the port (or stdin, e.g. the native build's output) into a
+// capture with the time of every read. replay writes it back to a port,
+// stdout or a new pty whose path is printed, so the Pi side can be run
+// against it as against the board; -s 10 plays ten times faster, -s 0 as
+// fast as possible. decode prints what the stream decoder makes of a
+// capture (-r for a raw byte dump instead, -B for the binary stream) and
+// the decoder's counters.
+
+#include "capture.h"
+#include "stream_decoder.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+
+  volatile bool gStop = false;
+
+  void onSignal(int)
+  {
+    gStop = true;
+  }
+
+  int usage()
+  {
+    fprintf(stderr,
+      "usage: maxcap record <port|-> <capture> [-b baud] [-t seconds]\n"
+      "       maxcap replay <capture> [port|pty|-] [-s speed]\n"
+      "       maxcap decode <capture|-> [-B] [-r] [-q]\n");
+    return 2;
+  }
+
+  int fail(const char *what, const char *path)
+  {
+    fprintf(stderr, "maxcap: %s %s: %s\n", what, path, strerror(errno));
+    return 1;
+  }
+
+  void printTemperature(int32_t thousandths)
+  {
+    printf("%s%d.%03d", thousandths < 0 ? "-" : "", abs(thousandths / 1000), abs(thousandths % 1000));
+  }
+
+  class Printer : public host::Listener {
+  public:
+    bool quiet;
+
+    void frame(const host::frame &f) override
+    {
+      if (quiet) {
+        return;
+      }
+      if (f.has_sequence) {
+        printf("frame %u", f.sequence);
+      }
+      else {
+        printf("frame -");
+      }
+      for (uint8_t i = 0; i < f.count; i++) {
+        const host::record &r = f.records[i];
+        printf(" ch%u=", r.channel);
+        if (r.status == 0) {
+          printTemperature(r.corrected);
+        }
+        else {
+          printf("fault(%d)", r.status);
+        }
+      }
+      if (f.has_door) {
+        printf(" door=%u@%u", (unsigned)f.door, f.door_position);
+      }
+      if (f.has_control) {
+        printf(" control=%s/%d", f.control.enabled ? "on" : "off", f.control.output);
+      }
+      printf("\n");
+    }
+
+    void alarm(const host::alarm_event &event) override
+    {
+      if (!quiet) {
+        printf("alarm ch%u condition=%u active=%d value=", event.channel, event.condition, event.active);
+        printTemperature(event.value);
+        printf("\n");
+      }
+    }
+
+    void reply(long id, uint8_t code) override
+    {
+      if (!quiet) {
+        printf("reply id=%ld code=%u\n", id, code);
+      }
+    }
+
+    void debug(const char *text, size_t length) override
+    {
+      if (!quiet) {
+        printf("debug %.*s\n", (int)length, text);
+      }
+    }
+
+    void other(const char *line, size_t length) override
+    {
+      if (!quiet) {
+        printf("other %.*s\n", (int)length, line);
+      }
+    }
+
+    void malformed(const uint8_t * /* data */, size_t length) override
+    {
+      if (!quiet) {
+        printf("malformed %zu bytes\n", length);
+      }
+    }
+  };
+
+  // Waits until a pty master's hangup state is hangup. False if stopped
+  // by a signal first.
+  bool waitForHangup(int fd, bool hangup)
+  {
+    while (!gStop) {
+      struct pollfd p = { fd, POLLIN, 0 };
+      poll(&p, 1, 100);
+      if (((p.revents & POLLHUP) != 0) == hangup) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  int record(int argc, char **argv)
+  {
+    if (argc < 2) {
+      return usage();
+    }
+    long baud = 115200;
+    long seconds = 0;
+    for (int i = 2; i + 1 < argc; i += 2) {
+      if (strcmp(argv[i], "-b") == 0) {
+        baud = atol(argv[i + 1]);
+      }
+      else if (strcmp(argv[i], "-t") == 0) {
+        seconds = atol(argv[i + 1]);
+      }
+      else {
+        return usage();
+      }
+    }
+
+    int fd = strcmp(argv[0], "-") == 0 ? STDIN_FILENO : host::open_serial(argv[0], baud);
+    if (fd < 0) {
+      return fail("cannot open", argv[0]);
+    }
+    host::CaptureWriter capture;
+    if (!capture.open(argv[1])) {
+      return fail("cannot create", argv[1]);
+    }
+    if (!host::record_port(fd, capture, (uint32_t)(seconds * 1000), gStop)) {
+      return fail("recording from", argv[0]);
+    }
+    return capture.close() ? 0 : fail("cannot write", argv[1]);
+  }
+
+  int replay(int argc, char **argv)
+  {
+    if (argc < 1) {
+      return usage();
+    }
+    const char *target = "-";
+    double speed = 1;
+    for (int i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+        speed = atof(argv[++i]);
+      }
+      else if (argv[i][0] != '-' || strcmp(argv[i], "-") == 0) {
+        target = argv[i];
+      }
+      else {
+        return usage();
+      }
+    }
+
+    host::CaptureReader capture;
+    if (!capture.open(argv[0])) {
+      return fail("cannot read", argv[0]);
+    }
+
+    bool pty = strcmp(target, "pty") == 0;
+    int fd;
+    if (strcmp(target, "-") == 0) {
+      fd = STDOUT_FILENO;
+    }
+    else if (pty) {
+      char name[64];
+      fd = host::open_pty(name, sizeof(name));
+      if (fd < 0) {
+        return fail("cannot open", "pty");
+      }
+      fprintf(stderr, "%s\n", name);
+
+      // the master reports a hangup until something opens the slave
+      if (!waitForHangup(fd, false)) {
+        return 0;
+      }
+    }
+    else {
+      fd = host::open_serial(target, 0);
+      if (fd < 0) {
+        return fail("cannot open", target);
+      }
+    }
+
+    if (!host::replay_capture(capture, fd, speed, gStop)) {
+      return fail("writing to", target);
+    }
+    // closing the master drops what the reader has not read yet, so keep
+    // it open until the reader is done
+    if (pty) {
+      waitForHangup(fd, true);
+    }
+    return 0;
+  }
+
+  int decode(int argc, char **argv)
+  {
+    if (argc < 1) {
+      return usage();
+    }
+    bool binary = false;
+    bool raw = false;
+    Printer printer;
+    printer.quiet = false;
+    for (int i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "-B") == 0) {
+        binary = true;
+      }
+      else if (strcmp(argv[i], "-r") == 0) {
+        raw = true;
+      }
+      else if (strcmp(argv[i], "-q") == 0) {
+        printer.quiet = true;
+      }
+      else {
+        return usage();
+      }
+    }
+
+    host::CaptureReader capture;
+    if (!capture.open(argv[0])) {
+      return fail("cannot read", argv[0]);
+    }
+
+    // the decoders are large, keep them off the stack
+    static host::JsonDecoder json(printer);
+    static host::BinaryDecoder binaryDecoder(printer);
+
+    uint32_t delta_us;
+    const uint8_t *data;
+    size_t length;
+    uint64_t time_us = 0;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (!gStop && capture.next(delta_us, data, length)) {
+      time_us += delta_us;
+      if (raw) {
+        printf("%10.6f %4zu ", time_us / 1e6, length);
+        fwrite(data, 1, length, stdout);
+        printf("\n");
+      }
+      else if (binary) {
+        binaryDecoder.feed(data, length);
+      }
+      else {
+        json.feed(data, length);
+      }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (raw) {
+      return 0;
+    }
+
+    const host::decoder_stats &stats = binary ? binaryDecoder.stats() : json.stats();
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(stderr, "%llu bytes over %.3f s captured, %llu frames, %llu lines, %llu malformed, %llu overflows\n",
+      (unsigned long long)stats.bytes, time_us / 1e6, (unsigned long long)stats.frames,
+      (unsigned long long)stats.lines, (unsigned long long)stats.malformed, (unsigned long long)stats.overflows);
+    if (elapsed > 0) {
+      fprintf(stderr, "decoded in %.3f ms, %.0f frames/s\n", elapsed * 1e3, stats.frames / elapsed);
+    }
+    return 0;
+  }
+};
+
+int main(int argc, char **argv)
+{
+  if (argc < 2) {
+    return usage();
+  }
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  signal(SIGPIPE, SIG_IGN);
+
+  if (strcmp(argv[1], "record") == 0) {
+    return record(argc - 2, argv + 2);
+  }
+  if (strcmp(argv[1], "replay") == 0) {
+    return replay(argc - 2, argv + 2);
+  }
+  if (strcmp(argv[1], "decode") == 0) {
+    return decode(argc - 2, argv + 2);
+  }
+  return usage();
+}
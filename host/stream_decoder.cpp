@@ -0,0 +1,731 @@
+#include "stream_decoder.h"
+
+#include <string.h>
+
+namespace {
+
+  // A small JSON reader over one line, for the shapes the firmware prints:
+  // objects, arrays, plain strings, decimal numbers and null. Nothing is
+  // copied; strings are returned as pointers into the line.
+  struct Cursor {
+    const char *p;
+    const char *end;
+  };
+
+  static const uint8_t MAX_DEPTH = 8;
+
+  void whitespace(Cursor &c)
+  {
+    while (c.p < c.end && (*c.p == ' ' || *c.p == '\t' || *c.p == '\r')) {
+      c.p++;
+    }
+  }
+
+  bool take(Cursor &c, char expected)
+  {
+    whitespace(c);
+    if (c.p < c.end && *c.p == expected) {
+      c.p++;
+      return true;
+    }
+    return false;
+  }
+
+  bool string(Cursor &c, const char *&text, size_t &length)
+  {
+    if (!take(c, '"')) {
+      return false;
+    }
+    text = c.p;
+    while (c.p < c.end && *c.p != '"') {
+      if (*c.p == '\\') {
+        c.p++;
+      }
+      c.p++;
+    }
+    if (c.p >= c.end) {
+      return false;
+    }
+    length = (size_t)(c.p - text);
+    c.p++;
+    return true;
+  }
+
+  bool literal(Cursor &c, const char *word)
+  {
+    size_t length = strlen(word);
+    if ((size_t)(c.end - c.p) < length || memcmp(c.p, word, length) != 0) {
+      return false;
+    }
+    c.p += length;
+    return true;
+  }
+
+  // A decimal number in thousandths, rounded half away from zero past the
+  // third decimal. null reads as 0 with is_null set.
+  bool number(Cursor &c, int64_t &thousandths, bool *is_null = NULL)
+  {
+    whitespace(c);
+    if (is_null) {
+      *is_null = false;
+    }
+    if (literal(c, "null")) {
+      if (!is_null) {
+        return false;
+      }
+      *is_null = true;
+      thousandths = 0;
+      return true;
+    }
+    bool negative = c.p < c.end && *c.p == '-';
+    if (negative) {
+      c.p++;
+    }
+    int64_t whole = 0;
+    uint8_t digits = 0;
+    while (c.p < c.end && *c.p >= '0' && *c.p <= '9') {
+      if (++digits > 15) {
+        return false;
+      }
+      whole = whole * 10 + (*c.p++ - '0');
+    }
+    if (digits == 0) {
+      return false;
+    }
+    int64_t fraction = 0;
+    if (c.p < c.end && *c.p == '.') {
+      c.p++;
+      uint8_t places = 0;
+      bool round_up = false;
+      while (c.p < c.end && *c.p >= '0' && *c.p <= '9') {
+        if (places < 3) {
+          fraction = fraction * 10 + (*c.p - '0');
+        }
+        else if (places == 3) {
+          round_up = *c.p >= '5';
+        }
+        places++;
+        c.p++;
+      }
+      if (places == 0) {
+        return false;
+      }
+      for (; places < 3; places++) {
+        fraction *= 10;
+      }
+      fraction += round_up ? 1 : 0;
+    }
+    if (c.p < c.end && (*c.p == 'e' || *c.p == 'E')) {
+      return false;     // never printed by the firmware
+    }
+    thousandths = whole * 1000 + fraction;
+    if (negative) {
+      thousandths = -thousandths;
+    }
+    return true;
+  }
+
+  bool integer(Cursor &c, int64_t &value)
+  {
+    int64_t thousandths;
+    if (!number(c, thousandths) || thousandths % 1000 != 0) {
+      return false;
+    }
+    value = thousandths / 1000;
+    return true;
+  }
+
+  bool skip(Cursor &c, uint8_t depth);
+
+  // Walks an object, calling member(key, length) for every member; member
+  // reads the value and returns false if it was malformed.
+  template <typename Member>
+  bool object(Cursor &c, Member member)
+  {
+    if (!take(c, '{')) {
+      return false;
+    }
+    if (take(c, '}')) {
+      return true;
+    }
+    do {
+      const char *key;
+      size_t length;
+      if (!string(c, key, length) || !take(c, ':') || !member(key, length)) {
+        return false;
+      }
+    } while (take(c, ','));
+    return take(c, '}');
+  }
+
+  template <typename Element>
+  bool array(Cursor &c, Element element)
+  {
+    if (!take(c, '[')) {
+      return false;
+    }
+    if (take(c, ']')) {
+      return true;
+    }
+    do {
+      if (!element()) {
+        return false;
+      }
+    } while (take(c, ','));
+    return take(c, ']');
+  }
+
+  bool skip(Cursor &c, uint8_t depth)
+  {
+    if (depth > MAX_DEPTH) {
+      return false;
+    }
+    whitespace(c);
+    if (c.p >= c.end) {
+      return false;
+    }
+    switch (*c.p) {
+      case '{':
+        return object(c, [&](const char *, size_t) { return skip(c, depth + 1); });
+      case '[':
+        return array(c, [&]() { return skip(c, depth + 1); });
+      case '"': {
+        const char *text;
+        size_t length;
+        return string(c, text, length);
+      }
+      default: {
+        if (literal(c, "true") || literal(c, "false")) {
+          return true;
+        }
+        int64_t value;
+        bool is_null;
+        return number(c, value, &is_null);
+      }
+    }
+  }
+
+  bool is(const char *key, size_t length, const char *name)
+  {
+    return strlen(name) == length && memcmp(key, name, length) == 0;
+  }
+
+  template <typename T>
+  bool field(Cursor &c, T &out)
+  {
+    int64_t value;
+    if (!integer(c, value)) {
+      return false;
+    }
+    out = (T)value;
+    return true;
+  }
+
+  bool temperature(Cursor &c, int32_t &out)
+  {
+    int64_t value;
+    if (!number(c, value)) {
+      return false;
+    }
+    out = (int32_t)value;
+    return true;
+  }
+
+  bool readRecord(Cursor &c, host::record &r)
+  {
+    memset(&r, 0, sizeof(r));
+    return object(c, [&](const char *key, size_t length) {
+      if (is(key, length, "channel")) {
+        return field(c, r.channel);
+      }
+      if (is(key, length, "status_code")) {
+        return field(c, r.status);
+      }
+      if (is(key, length, "junction")) {
+        return temperature(c, r.junction);
+      }
+      if (is(key, length, "value")) {
+        return temperature(c, r.value);
+      }
+      if (is(key, length, "corrected")) {
+        return temperature(c, r.corrected);
+      }
+      if (is(key, length, "time")) {
+        return field(c, r.time);
+      }
+      return skip(c, 2);
+    });
+  }
+
+  host::door_state doorState(const char *name, size_t length)
+  {
+    if (is(name, length, "closed")) return host::door_state::CLOSED;
+    if (is(name, length, "open")) return host::door_state::OPEN;
+    if (is(name, length, "closing")) return host::door_state::CLOSING;
+    if (is(name, length, "opening")) return host::door_state::OPENING;
+    if (is(name, length, "control")) return host::door_state::CONTROLLED;
+    return host::door_state::UNKNOWN;
+  }
+
+  bool readDoor(Cursor &c, host::frame &f)
+  {
+    f.has_door = true;
+    return object(c, [&](const char *key, size_t length) {
+      if (is(key, length, "state")) {
+        const char *name;
+        size_t name_length;
+        if (!string(c, name, name_length)) {
+          return false;
+        }
+        f.door = doorState(name, name_length);
+        return true;
+      }
+      if (is(key, length, "position")) {
+        return field(c, f.door_position);
+      }
+      return skip(c, 2);
+    });
+  }
+
+  bool readControl(Cursor &c, host::control &out)
+  {
+    return object(c, [&](const char *key, size_t length) {
+      if (is(key, length, "enabled")) {
+        int64_t enabled;
+        if (!integer(c, enabled)) {
+          return false;
+        }
+        out.enabled = enabled != 0;
+        return true;
+      }
+      if (is(key, length, "setpoint")) {
+        return temperature(c, out.setpoint);
+      }
+      if (is(key, length, "input")) {
+        int64_t input;
+        bool is_null;
+        if (!number(c, input, &is_null)) {
+          return false;
+        }
+        out.input_valid = !is_null;
+        out.input = (int32_t)input;
+        return true;
+      }
+      if (is(key, length, "output")) {
+        return field(c, out.output);
+      }
+      if (is(key, length, "p")) {
+        return field(c, out.p);
+      }
+      if (is(key, length, "i")) {
+        return field(c, out.i);
+      }
+      if (is(key, length, "d")) {
+        return field(c, out.d);
+      }
+      return skip(c, 2);
+    });
+  }
+
+  uint8_t alarmCondition(const char *name, size_t length)
+  {
+    if (is(name, length, "over")) return 1;
+    if (is(name, length, "under")) return 2;
+    if (is(name, length, "rise")) return 4;
+    if (is(name, length, "fault")) return 8;
+    return 0;
+  }
+
+  bool readAlarm(Cursor &c, host::alarm_event &event)
+  {
+    return object(c, [&](const char *key, size_t length) {
+      if (is(key, length, "channel")) {
+        return field(c, event.channel);
+      }
+      if (is(key, length, "condition")) {
+        const char *name;
+        size_t name_length;
+        if (!string(c, name, name_length)) {
+          return false;
+        }
+        event.condition = alarmCondition(name, name_length);
+        return true;
+      }
+      if (is(key, length, "active")) {
+        int64_t active;
+        if (!integer(c, active)) {
+          return false;
+        }
+        event.active = active != 0;
+        return true;
+      }
+      if (is(key, length, "status_code")) {
+        return field(c, event.status);
+      }
+      if (is(key, length, "value")) {
+        return temperature(c, event.value);
+      }
+      if (is(key, length, "time")) {
+        return field(c, event.time);
+      }
+      return skip(c, 2);
+    });
+  }
+
+  // { "ack": {"id": 12}} and { "error": {["id": 12, ]"code": 5, ...}}
+  bool readReply(Cursor &c, long &id, uint8_t &code)
+  {
+    return object(c, [&](const char *key, size_t length) {
+      if (is(key, length, "id")) {
+        return field(c, id);
+      }
+      if (is(key, length, "code")) {
+        return field(c, code);
+      }
+      return skip(c, 2);
+    });
+  }
+
+  uint16_t u16(const uint8_t *p)
+  {
+    return (uint16_t)(p[0] | p[1] << 8);
+  }
+
+  uint32_t u32(const uint8_t *p)
+  {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+  }
+
+  // CRC-16/CCITT-FALSE a byte at a time, same as binary_frame.cpp.
+  struct CrcTable {
+    uint16_t entries[256];
+
+    CrcTable()
+    {
+      for (uint16_t i = 0; i < 256; i++) {
+        uint16_t crc = (uint16_t)(i << 8);
+        for (uint8_t bit = 0; bit < 8; bit++) {
+          crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+        entries[i] = crc;
+      }
+    }
+  };
+
+  const CrcTable gCrcTable;
+
+  // Fixed point counts to thousandths, rounded half away from zero.
+  int32_t thousandths(int16_t counts, uint8_t fraction_bits)
+  {
+    int32_t scaled = (int32_t)counts * 1000;
+    int32_t half = 1L << (fraction_bits - 1);
+    return scaled >= 0 ? (scaled + half) >> fraction_bits : -((-scaled + half) >> fraction_bits);
+  }
+};
+
+uint16_t host::crc16(const uint8_t *data, size_t length, uint16_t crc)
+{
+  while (length--) {
+    crc = (uint16_t)(crc << 8) ^ gCrcTable.entries[(crc >> 8) ^ *data++];
+  }
+  return crc;
+}
+
+bool host::decode_line(const char *line, size_t length, Listener &listener, decoder_stats &stats)
+{
+  stats.lines++;
+  while (length > 0 && line[length - 1] == '\r') {
+    length--;
+  }
+  if (length == 0) {
+    return true;
+  }
+  if (line[0] == '#') {
+    size_t skip = length > 1 && line[1] == ' ' ? 2 : 1;
+    listener.debug(line + skip, length - skip);
+    return true;
+  }
+
+  Cursor c = { line, line + length };
+  frame f;
+  f.has_sequence = false;
+  f.count = 0;
+  f.has_door = false;
+  f.has_control = false;
+  alarm_event event;
+  memset(&event, 0, sizeof(event));
+  long id = -1;
+  uint8_t code = 0;
+  enum { OTHER, FRAME, ALARM, REPLY } kind = OTHER;
+
+  bool ok = object(c, [&](const char *key, size_t key_length) {
+    if (is(key, key_length, "seq")) {
+      kind = FRAME;
+      f.has_sequence = true;
+      return field(c, f.sequence);
+    }
+    if (is(key, key_length, "temperature")) {
+      kind = FRAME;
+      return array(c, [&]() {
+        if (f.count == MAX_RECORDS) {
+          return skip(c, 1);
+        }
+        return readRecord(c, f.records[f.count++]);
+      });
+    }
+    if (is(key, key_length, "door")) {
+      kind = FRAME;
+      return readDoor(c, f);
+    }
+    if (is(key, key_length, "control")) {
+      kind = FRAME;
+      memset(&f.control, 0, sizeof(f.control));
+      f.has_control = true;
+      return readControl(c, f.control);
+    }
+    if (is(key, key_length, "alarm")) {
+      kind = ALARM;
+      return readAlarm(c, event);
+    }
+    if (is(key, key_length, "ack") || is(key, key_length, "error")) {
+      kind = REPLY;
+      return readReply(c, id, code);
+    }
+    return skip(c, 1);
+  });
+  whitespace(c);
+  if (!ok || c.p != c.end) {
+    stats.malformed++;
+    listener.malformed((const uint8_t *)line, length);
+    return false;
+  }
+
+  switch (kind) {
+    case FRAME:
+      stats.frames++;
+      listener.frame(f);
+      break;
+    case ALARM:
+      listener.alarm(event);
+      break;
+    case REPLY:
+      listener.reply(id, code);
+      break;
+    default:
+      listener.other(line, length);
+      break;
+  }
+  return true;
+}
+
+host::JsonDecoder::JsonDecoder(Listener &listener) : _listener(listener), _length(0), _overflow(false)
+{
+  memset(&_stats, 0, sizeof(_stats));
+}
+
+void host::JsonDecoder::feed(const uint8_t *data, size_t length)
+{
+  _stats.bytes += length;
+  const uint8_t *end = data + length;
+  while (data < end) {
+    const uint8_t *newline = (const uint8_t *)memchr(data, '\n', (size_t)(end - data));
+    size_t chunk = (size_t)((newline ? newline : end) - data);
+    if (!_overflow) {
+      if (_length + chunk > MAX_LINE) {
+        _overflow = true;
+        _stats.overflows++;
+      }
+      else {
+        memcpy(_line + _length, data, chunk);
+        _length += chunk;
+      }
+    }
+    if (!newline) {
+      return;
+    }
+    if (!_overflow) {
+      decode_line(_line, _length, _listener, _stats);
+    }
+    _length = 0;
+    _overflow = false;
+    data = newline + 1;
+  }
+}
+
+host::BinaryDecoder::BinaryDecoder(Listener &listener) : _listener(listener), _length(0), _overflow(false)
+{
+  memset(&_stats, 0, sizeof(_stats));
+}
+
+void host::BinaryDecoder::feed(const uint8_t *data, size_t length)
+{
+  _stats.bytes += length;
+  const uint8_t *end = data + length;
+  while (data < end) {
+    const uint8_t *zero = (const uint8_t *)memchr(data, 0x00, (size_t)(end - data));
+    const uint8_t *stop = zero ? zero : end;
+
+    // Text lines between frames. A COBS code byte is at most 1 + the
+    // largest frame, so a segment starting with '{' is always text. A '#'
+    // code byte is followed by the frame type, which is not printable.
+    uint8_t first = _length > 0 ? _segment[0] : data[0];
+    const uint8_t *newline = NULL;
+    if (first == '{' || first == '#') {
+      newline = (const uint8_t *)memchr(data, '\n', (size_t)(stop - data));
+      stop = newline ? newline : stop;
+    }
+    append(data, (size_t)(stop - data));
+    data = stop;
+
+    if (newline) {
+      data++;
+      if (_overflow) {
+        _length = 0;
+        _overflow = false;
+      }
+      else if (text()) {
+        decode_line((const char *)_segment, _length, _listener, _stats);
+        _length = 0;
+      }
+      else {
+        append(newline, 1);
+      }
+    }
+    else if (zero) {
+      data++;
+      segment();
+    }
+  }
+}
+
+void host::BinaryDecoder::append(const uint8_t *data, size_t length)
+{
+  if (_overflow) {
+    return;
+  }
+  if (_length + length > MAX_SEGMENT) {
+    _overflow = true;
+    _stats.overflows++;
+    return;
+  }
+  memcpy(_segment + _length, data, length);
+  _length += length;
+}
+
+bool host::BinaryDecoder::text() const
+{
+  if (_segment[0] == '{') {
+    return true;
+  }
+  for (size_t i = 0; i < _length; i++) {
+    if ((_segment[i] < 0x20 || _segment[i] > 0x7e) && _segment[i] != '\r') {
+      return false;
+    }
+  }
+  return true;
+}
+
+void host::BinaryDecoder::segment()
+{
+  if (!_overflow && _length > 0 && !decodeFrame(_segment, _length)) {
+    _stats.malformed++;
+    _listener.malformed(_segment, _length);
+  }
+  _length = 0;
+  _overflow = false;
+}
+
+bool host::BinaryDecoder::decodeFrame(const uint8_t *data, size_t length)
+{
+  // COBS decode
+  uint8_t decoded[256];
+  size_t size = 0;
+  size_t i = 0;
+  while (i < length) {
+    uint8_t code = data[i++];
+    if (code == 0 || i + code - 1 > length || size + code > sizeof(decoded)) {
+      return false;
+    }
+    for (uint8_t j = 1; j < code; j++) {
+      decoded[size++] = data[i++];
+    }
+    if (code < 0xff && i < length) {
+      decoded[size++] = 0;
+    }
+  }
+  if (size < 3 || crc16(decoded, size - 2) != u16(decoded + size - 2)) {
+    return false;
+  }
+
+  const uint8_t *p = decoded + 1;
+  size_t payload = size - 3;
+  frame f;
+  f.has_sequence = true;
+  f.count = 0;
+  f.has_door = false;
+  f.has_control = false;
+
+  switch (decoded[0]) {
+    case 0x01: {    // TEMPERATURE
+      if (payload < 5 || payload != 5 + (size_t)p[4] * 12 || p[4] > MAX_RECORDS) {
+        return false;
+      }
+      f.sequence = u32(p);
+      f.count = p[4];
+      for (uint8_t r = 0; r < f.count; r++) {
+        const uint8_t *in = p + 5 + r * 12;
+        record &out = f.records[r];
+        out.channel = in[0];
+        out.status = (int8_t)in[1];
+        out.value = thousandths((int16_t)u16(in + 2), 2);
+        out.junction = thousandths((int16_t)u16(in + 4), 4);
+        out.corrected = thousandths((int16_t)u16(in + 6), 4);
+        out.time = u32(in + 8);
+      }
+      break;
+    }
+    case 0x02:      // DOOR
+      if (payload != 7) {
+        return false;
+      }
+      f.sequence = u32(p);
+      f.has_door = true;
+      f.door = p[4] <= 4 ? (door_state)p[4] : door_state::UNKNOWN;
+      f.door_position = u16(p + 5);
+      break;
+    case 0x03:      // CONTROL
+      if (payload != 17) {
+        return false;
+      }
+      f.sequence = u32(p);
+      f.has_control = true;
+      f.control.enabled = (p[4] & 1) != 0;
+      f.control.input_valid = (p[4] & 2) != 0;
+      f.control.setpoint = thousandths((int16_t)u16(p + 5), 2);
+      f.control.input = thousandths((int16_t)u16(p + 7), 2);
+      f.control.output = (int16_t)u16(p + 9);
+      f.control.p = (int16_t)u16(p + 11);
+      f.control.i = (int16_t)u16(p + 13);
+      f.control.d = (int16_t)u16(p + 15);
+      break;
+    case 0x04: {    // ALARM
+      if (payload != 10) {
+        return false;
+      }
+      alarm_event event;
+      event.channel = p[0];
+      event.condition = p[1];
+      event.active = p[2] != 0;
+      event.status = (int8_t)p[3];
+      event.value = thousandths((int16_t)u16(p + 4), 2);
+      event.time = u32(p + 6);
+      _listener.alarm(event);
+      return true;
+    }
+    default:
+      return false;
+  }
+  _stats.frames++;
+  _listener.frame(f);
+  return true;
+}
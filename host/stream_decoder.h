@@ -0,0 +1,151 @@
+#ifndef _GGH_HOST_STREAM_DECODER_H_
+#define _GGH_HOST_STREAM_DECODER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Host side decoder for what the board writes to its serial port, for the
+// controller on the Raspberry Pi and for replaying captures (see
+// capture.h). Bytes are fed in whatever pieces the port hands over and
+// decoded into plain structs passed to a Listener. All state lives inside
+// the decoder, so after construction nothing is allocated.
+//
+// Temperatures are thousandths of a degree C, which holds every value the
+// JSON stream prints and the binary stream's 0.25 C and 0.0625 C steps
+// rounded to the nearest thousandth.
+namespace host {
+
+  static const uint8_t MAX_RECORDS = 8;
+
+  // Door states, as in binary_frame.h.
+  enum class door_state : uint8_t {
+    CLOSED     = 0,
+    OPEN       = 1,
+    CLOSING    = 2,
+    OPENING    = 3,
+    CONTROLLED = 4,
+    UNKNOWN    = 0xff
+  };
+
+  struct record {
+    uint8_t channel;
+    int8_t status;        // thermocouple status code, 0 okay
+    int32_t junction;
+    int32_t value;
+    int32_t corrected;
+    uint32_t time;        // device millis() of the reading
+  };
+
+  struct control {
+    bool enabled;
+    bool input_valid;
+    int32_t setpoint;
+    int32_t input;
+    int16_t output;       // permille of door travel
+    int16_t p;
+    int16_t i;
+    int16_t d;
+  };
+
+  // One streamed frame. JSON frames carry everything a period sent. Binary
+  // streams send the temperatures, door and controller of a period as
+  // separate frames sharing the sequence number, and each arrives as its
+  // own frame here. T ONESHOT replies have no sequence number.
+  struct frame {
+    bool has_sequence;
+    uint32_t sequence;
+    uint8_t count;
+    record records[MAX_RECORDS];
+    bool has_door;
+    door_state door;
+    uint16_t door_position;
+    bool has_control;
+    host::control control;
+  };
+
+  struct alarm_event {
+    uint8_t channel;
+    uint8_t condition;    // 1 over, 2 under, 4 rise, 8 fault
+    bool active;
+    int8_t status;
+    int32_t value;
+    uint32_t time;
+  };
+
+  // Override what you need. Pointers are only valid during the call.
+  class Listener {
+  public:
+    virtual ~Listener() {}
+
+    virtual void frame(const host::frame &) {}
+    virtual void alarm(const alarm_event &) {}
+    // An acknowledgement (code 0) or error. id is -1 for a command sent
+    // without a request id.
+    virtual void reply(long /* id */, uint8_t /* code */) {}
+    // A "# ..." line, without the "# " and the line end.
+    virtual void debug(const char * /* text */, size_t /* length */) {}
+    // Any other JSON line (clock, filter, link, ... replies), as is.
+    virtual void other(const char * /* line */, size_t /* length */) {}
+    // A line or binary frame that could not be decoded.
+    virtual void malformed(const uint8_t * /* data */, size_t /* length */) {}
+  };
+
+  struct decoder_stats {
+    uint64_t bytes;
+    uint64_t frames;
+    uint64_t lines;
+    uint64_t malformed;
+    uint64_t overflows;   // lines or frames too long for the buffer, dropped
+  };
+
+  // The JSON stream (T S1 / S1) and everything else the board prints.
+  class JsonDecoder {
+  public:
+    static const size_t MAX_LINE = 2048;
+
+    explicit JsonDecoder(Listener &listener);
+
+    void feed(const uint8_t *data, size_t length);
+    const decoder_stats &stats() const { return _stats; }
+
+  private:
+    Listener &_listener;
+    decoder_stats _stats;
+    char _line[MAX_LINE];
+    size_t _length;
+    bool _overflow;
+  };
+
+  // The binary stream (T S2 / S2): COBS frames ended by 0x00. Command
+  // replies and debug lines are text between the frames, told apart by
+  // their first byte and decoded as by JsonDecoder.
+  class BinaryDecoder {
+  public:
+    static const size_t MAX_SEGMENT = 2048;
+
+    explicit BinaryDecoder(Listener &listener);
+
+    void feed(const uint8_t *data, size_t length);
+    const decoder_stats &stats() const { return _stats; }
+
+  private:
+    Listener &_listener;
+    decoder_stats _stats;
+    uint8_t _segment[MAX_SEGMENT];
+    size_t _length;
+    bool _overflow;
+
+    void append(const uint8_t *data, size_t length);
+    bool text() const;
+    void segment();
+    bool decodeFrame(const uint8_t *data, size_t length);
+  };
+
+  // Decodes one complete JSON or debug line, without its line end. Returns
+  // false if it was malformed; the listener has been told either way.
+  bool decode_line(const char *line, size_t length, Listener &listener, decoder_stats &stats);
+
+  uint16_t crc16(const uint8_t *data, size_t length, uint16_t crc = 0xffff);
+};
+
+#endif // _GGH_HOST_STREAM_DECODER_H_
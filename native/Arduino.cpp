@@ -0,0 +1,86 @@
+#include "Arduino.h"
+#include "util/delay.h"
+
+#include <chrono>
+#include <thread>
+
+#include "sim.h"
+
+#define NUM_DIGITAL_PINS 20
+
+static uint8_t pin_modes[NUM_DIGITAL_PINS];
+static uint8_t pin_levels[NUM_DIGITAL_PINS];
+
+static const std::chrono::steady_clock::time_point boot = std::chrono::steady_clock::now();
+static uint64_t clock_offset_us = 0;
+
+static uint64_t elapsed_us()
+{
+  auto now = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(now - boot).count() + clock_offset_us;
+}
+
+void sim::clock::advance_micros(uint64_t us)
+{
+  clock_offset_us += us;
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  if (pin < NUM_DIGITAL_PINS) {
+    pin_modes[pin] = mode;
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+  if (pin < NUM_DIGITAL_PINS) {
+    pin_levels[pin] = val ? HIGH : LOW;
+    sim::bus::chip_select(pin, pin_levels[pin]);
+  }
+}
+
+int digitalRead(uint8_t pin)
+{
+  return pin < NUM_DIGITAL_PINS ? pin_levels[pin] : LOW;
+}
+
+unsigned long millis()
+{
+  return (uint32_t)(elapsed_us() / 1000);
+}
+
+unsigned long micros()
+{
+  return (uint32_t)elapsed_us();
+}
+
+void delay(unsigned long ms)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  _delay_us(us);
+}
+
+void _delay_ms(double ms)
+{
+  _delay_us(ms * 1000.0);
+}
+
+void _delay_us(double us)
+{
+  uint64_t until = elapsed_us() + (uint64_t)us;
+  while (elapsed_us() < until) {
+  }
+}
+
+void noInterrupts()
+{
+}
+
+void interrupts()
+{
+}
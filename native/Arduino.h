@@ -0,0 +1,50 @@
+#ifndef _GGH_NATIVE_ARDUINO_H_
+#define _GGH_NATIVE_ARDUINO_H_
+
+// Host stand-in for the part of the Arduino core the firmware uses. Only
+// compiled into the native environments; see sim.h for the knobs that drive
+// the simulated hardware.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "avr/pgmspace.h"
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT        0x0
+#define OUTPUT       0x1
+#define INPUT_PULLUP 0x2
+
+#define LSBFIRST 0
+#define MSBFIRST 1
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+// Both clocks wrap at 32 bits, exactly like the AVR core.
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void noInterrupts();
+void interrupts();
+
+#include "WString.h"
+#include "Print.h"
+#include "Stream.h"
+#include "HardwareSerial.h"
+
+void setup();
+void loop();
+
+#endif // _GGH_NATIVE_ARDUINO_H_
@@ -0,0 +1,80 @@
+#include "EEPROM.h"
+
+#include <string.h>
+
+#include "Arduino.h"
+#include "sim.h"
+
+EEPROMClass EEPROM;
+
+static uint8_t cells[E2END + 1];
+static bool erased = false;
+static uint64_t write_count = 0;
+
+static const uint32_t WRITE_TIME_US = 3300;
+static uint32_t write_started = 0;
+static bool writing = false;
+static uint64_t wait_count = 0;
+
+static void wait_until_ready()
+{
+  if (!eeprom_is_ready()) {
+    wait_count++;
+    while (!eeprom_is_ready()) {
+    }
+  }
+}
+
+bool eeprom_is_ready()
+{
+  if (writing && micros() - write_started >= WRITE_TIME_US) {
+    writing = false;
+  }
+  return !writing;
+}
+
+uint64_t sim::eeprom::writes()
+{
+  return write_count;
+}
+
+uint64_t sim::eeprom::waits()
+{
+  return wait_count;
+}
+
+void sim::eeprom::erase()
+{
+  memset(cells, 0xff, sizeof(cells));
+  erased = true;
+}
+
+uint8_t EEPROMClass::read(int idx)
+{
+  if (!erased) {
+    sim::eeprom::erase();
+  }
+  wait_until_ready();
+  return idx >= 0 && idx < length() ? cells[idx] : 0xff;
+}
+
+void EEPROMClass::write(int idx, uint8_t val)
+{
+  if (!erased) {
+    sim::eeprom::erase();
+  }
+  if (idx >= 0 && idx < length()) {
+    wait_until_ready();
+    cells[idx] = val;
+    write_count++;
+    write_started = micros();
+    writing = true;
+  }
+}
+
+void EEPROMClass::update(int idx, uint8_t val)
+{
+  if (read(idx) != val) {
+    write(idx, val);
+  }
+}
@@ -0,0 +1,38 @@
+#ifndef _GGH_NATIVE_EEPROM_H_
+#define _GGH_NATIVE_EEPROM_H_
+
+#include <stdint.h>
+
+#include "avr/eeprom.h"
+
+// 1 KiB, erased to 0xff, the same as an ATmega328P. write() blocks while
+// the previous write is still in progress (see avr/eeprom.h).
+class EEPROMClass {
+public:
+  uint8_t read(int idx);
+  void write(int idx, uint8_t val);
+  void update(int idx, uint8_t val);
+  uint16_t length() { return E2END + 1; }
+
+  template <typename T> T &get(int idx, T &t)
+  {
+    uint8_t *ptr = (uint8_t *)&t;
+    for (unsigned int i = 0; i < sizeof(T); i++) {
+      *ptr++ = read(idx + i);
+    }
+    return t;
+  }
+
+  template <typename T> const T &put(int idx, const T &t)
+  {
+    const uint8_t *ptr = (const uint8_t *)&t;
+    for (unsigned int i = 0; i < sizeof(T); i++) {
+      update(idx + i, *ptr++);
+    }
+    return t;
+  }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif // _GGH_NATIVE_EEPROM_H_
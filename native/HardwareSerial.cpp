@@ -0,0 +1,163 @@
+#include "HardwareSerial.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <deque>
+#include <string>
+
+#include "Arduino.h"
+#include "sim.h"
+
+HardwareSerial Serial;
+
+static std::deque<uint8_t> rx;
+static std::string captured_tx;
+static uint64_t tx_count = 0;
+static sim::serial::output tx_mode = sim::serial::output::console;
+
+// Line rate model: the TX buffer drains at baud / 10 bytes per second (8N1)
+// and a write into a full buffer spins until a slot frees up, as on AVR.
+static const int TX_QUEUE_SIZE = SERIAL_TX_BUFFER_SIZE - 1;
+static unsigned long line_rate = 0;
+static double tx_queued = 0;
+static unsigned long tx_drained_at = 0;
+static uint64_t tx_wait_count = 0;
+static uint64_t tx_blocked = 0;
+
+static void drain_tx()
+{
+  unsigned long now = micros();
+  tx_queued -= (double)(now - tx_drained_at) * line_rate / 10 / 1000000;
+  if (tx_queued < 0) {
+    tx_queued = 0;
+  }
+  tx_drained_at = now;
+}
+
+static void queue_tx(size_t size)
+{
+  if (line_rate == 0) {
+    return;
+  }
+  drain_tx();
+  if (tx_queued + size > TX_QUEUE_SIZE) {
+    unsigned long started = micros();
+    tx_wait_count++;
+    while (size > 0) {
+      drain_tx();
+      while (size > 0 && tx_queued + 1 <= TX_QUEUE_SIZE) {
+        tx_queued += 1;
+        size--;
+      }
+    }
+    tx_blocked += micros() - started;
+    return;
+  }
+  tx_queued += size;
+}
+
+void sim::serial::set_line_rate(unsigned long baud)
+{
+  line_rate = baud;
+  tx_queued = 0;
+  tx_drained_at = micros();
+}
+
+uint64_t sim::serial::tx_waits()
+{
+  return tx_wait_count;
+}
+
+uint64_t sim::serial::tx_blocked_us()
+{
+  return tx_blocked;
+}
+
+void sim::serial::set_output(output mode)
+{
+  tx_mode = mode;
+}
+
+void sim::serial::feed(const char *bytes)
+{
+  feed((const uint8_t *)bytes, strlen(bytes));
+}
+
+void sim::serial::feed(const uint8_t *bytes, size_t length)
+{
+  rx.insert(rx.end(), bytes, bytes + length);
+}
+
+const std::string &sim::serial::captured()
+{
+  return captured_tx;
+}
+
+void sim::serial::clear_captured()
+{
+  captured_tx.clear();
+}
+
+uint64_t sim::serial::tx_bytes()
+{
+  return tx_count;
+}
+
+int HardwareSerial::available()
+{
+  return (int)rx.size();
+}
+
+int HardwareSerial::peek()
+{
+  return rx.empty() ? -1 : rx.front();
+}
+
+int HardwareSerial::read()
+{
+  if (rx.empty()) {
+    return -1;
+  }
+  uint8_t c = rx.front();
+  rx.pop_front();
+  return c;
+}
+
+int HardwareSerial::availableForWrite()
+{
+  if (line_rate == 0) {
+    return TX_QUEUE_SIZE;
+  }
+  drain_tx();
+  return TX_QUEUE_SIZE - (int)ceil(tx_queued);
+}
+
+void HardwareSerial::flush()
+{
+  if (tx_mode == sim::serial::output::console) {
+    fflush(stdout);
+  }
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+  queue_tx(size);
+  tx_count += size;
+  switch (tx_mode) {
+    case sim::serial::output::console:
+      fwrite(buffer, 1, size, stdout);
+      break;
+    case sim::serial::output::capture:
+      captured_tx.append((const char *)buffer, size);
+      break;
+    case sim::serial::output::discard:
+      break;
+  }
+  return size;
+}
@@ -0,0 +1,32 @@
+#ifndef _GGH_NATIVE_HARDWARESERIAL_H_
+#define _GGH_NATIVE_HARDWARESERIAL_H_
+
+#include "Stream.h"
+
+#define SERIAL_TX_BUFFER_SIZE 64
+#define SERIAL_RX_BUFFER_SIZE 64
+
+// Where the bytes end up is decided by sim::serial::set_output().
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long baud) { _baud = baud; }
+  void end() {}
+
+  virtual int available() override;
+  virtual int peek() override;
+  virtual int read() override;
+  virtual int availableForWrite() override;
+  virtual void flush() override;
+  virtual size_t write(uint8_t) override;
+  virtual size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+
+  operator bool() { return true; }
+
+private:
+  unsigned long _baud = 0;
+};
+
+extern HardwareSerial Serial;
+
+#endif // _GGH_NATIVE_HARDWARESERIAL_H_
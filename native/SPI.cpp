@@ -0,0 +1,158 @@
+#include "SPI.h"
+
+#include <map>
+
+#include "sim.h"
+
+SPIClass SPI;
+
+namespace {
+  // Worst case conversion time from the datasheet.
+  const uint32_t CONVERSION_US = 100000;
+
+  // A chip converts continuously while CS is high. Pulling CS low stops the
+  // conversion in progress and shifts out the last completed result.
+  struct chip {
+    uint32_t frame;       // what the next conversion will measure
+    uint32_t result;      // last completed conversion
+    uint32_t conversion_started;
+    uint64_t reads;
+    uint64_t stale_reads;
+  };
+
+  std::map<uint8_t, chip> chips;
+  std::map<uint8_t, uint64_t> unanswered_reads;
+  chip *selected = nullptr;
+  bool any_selected = false;
+  uint8_t selected_pin = 0;
+  uint32_t shift_register = 0;
+  uint8_t shifted = 0;
+  uint8_t floating_level = 0x00;
+  uint64_t total_reads = 0;
+  uint64_t total_stale_reads = 0;
+}
+
+uint8_t SPIClass::transfer(uint8_t data)
+{
+  return sim::bus::transfer(data);
+}
+
+uint32_t sim::max31855::encode(double thermocouple, double junction, uint8_t faults)
+{
+  int32_t tc = (int32_t)lround(thermocouple * 4.0);
+  int32_t cj = (int32_t)lround(junction * 16.0);
+
+  uint32_t frame = ((uint32_t)tc & 0x3FFF) << 18;
+  frame |= ((uint32_t)cj & 0x0FFF) << 4;
+  if (faults) {
+    frame |= 0x00010000 | (faults & 0x07);
+  }
+  return frame;
+}
+
+void sim::max31855::attach(uint8_t chip_select, double thermocouple, double junction)
+{
+  uint32_t frame = encode(thermocouple, junction);
+  chips[chip_select] = chip { frame, frame, (uint32_t)micros() - CONVERSION_US, 0, 0 };
+}
+
+void sim::max31855::detach(uint8_t chip_select)
+{
+  if (any_selected && selected_pin == chip_select) {
+    selected = nullptr;
+  }
+  chips.erase(chip_select);
+}
+
+void sim::max31855::set_temperature(uint8_t chip_select, double thermocouple, double junction)
+{
+  auto it = chips.find(chip_select);
+  if (it != chips.end()) {
+    it->second.frame = encode(thermocouple, junction, it->second.frame & 0x07);
+  }
+}
+
+void sim::max31855::set_fault(uint8_t chip_select, uint8_t faults)
+{
+  auto it = chips.find(chip_select);
+  if (it != chips.end()) {
+    it->second.frame = (it->second.frame & ~0x00010007) | (faults ? 0x00010000 | (faults & 0x07) : 0);
+  }
+}
+
+void sim::max31855::set_floating_level(uint8_t level)
+{
+  floating_level = level;
+}
+
+uint64_t sim::max31855::frames_read(uint8_t chip_select)
+{
+  auto it = chips.find(chip_select);
+  if (it != chips.end()) {
+    return it->second.reads;
+  }
+  auto unanswered = unanswered_reads.find(chip_select);
+  return unanswered != unanswered_reads.end() ? unanswered->second : 0;
+}
+
+uint64_t sim::max31855::frames_read()
+{
+  return total_reads;
+}
+
+uint64_t sim::max31855::stale_frames_read()
+{
+  return total_stale_reads;
+}
+
+void sim::bus::chip_select(uint8_t pin, uint8_t level)
+{
+  if (level == LOW) {
+    auto it = chips.find(pin);
+    selected = it != chips.end() ? &it->second : nullptr;
+    any_selected = true;
+    selected_pin = pin;
+    if (selected) {
+      if ((uint32_t)micros() - selected->conversion_started >= CONVERSION_US) {
+        selected->result = selected->frame;
+      }
+      else {
+        selected->stale_reads++;
+        total_stale_reads++;
+      }
+    }
+    shift_register = selected ? selected->result : 0;
+    shifted = 0;
+  }
+  else if (any_selected && pin == selected_pin) {
+    if (selected) {
+      selected->conversion_started = (uint32_t)micros();
+    }
+    // a frame counts once all 32 bits were clocked out
+    if (shifted >= 4) {
+      total_reads++;
+      if (selected) {
+        selected->reads++;
+      }
+      else {
+        unanswered_reads[pin]++;
+      }
+    }
+    selected = nullptr;
+    any_selected = false;
+  }
+}
+
+uint8_t sim::bus::transfer(uint8_t)
+{
+  if (!any_selected) {
+    return floating_level;
+  }
+  shifted++;
+  if (!selected) {
+    return floating_level;
+  }
+  uint8_t out = (uint8_t)(shift_register >> 24);
+  shift_register <<= 8;
+  return out;
+}
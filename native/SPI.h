@@ -0,0 +1,45 @@
+#ifndef _GGH_NATIVE_SPI_H_
+#define _GGH_NATIVE_SPI_H_
+
+#include "Arduino.h"
+
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x04
+#define SPI_MODE2 0x08
+#define SPI_MODE3 0x0C
+
+#define SPI_CLOCK_DIV4   0x00
+#define SPI_CLOCK_DIV16  0x01
+#define SPI_CLOCK_DIV64  0x02
+#define SPI_CLOCK_DIV128 0x03
+#define SPI_CLOCK_DIV2   0x04
+#define SPI_CLOCK_DIV8   0x05
+#define SPI_CLOCK_DIV32  0x06
+
+class SPISettings {
+public:
+  SPISettings() : clock(4000000), bitOrder(MSBFIRST), dataMode(SPI_MODE0) {}
+  SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode)
+    : clock(clock), bitOrder(bitOrder), dataMode(dataMode) {}
+
+  uint32_t clock;
+  uint8_t bitOrder;
+  uint8_t dataMode;
+};
+
+// Bytes are exchanged with whichever simulated chip has its CS pin low.
+class SPIClass {
+public:
+  static void begin() {}
+  static void end() {}
+  static void beginTransaction(SPISettings) {}
+  static void endTransaction() {}
+  static void setDataMode(uint8_t) {}
+  static void setBitOrder(uint8_t) {}
+  static void setClockDivider(uint8_t) {}
+  static uint8_t transfer(uint8_t data);
+};
+
+extern SPIClass SPI;
+
+#endif // _GGH_NATIVE_SPI_H_
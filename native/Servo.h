@@ -0,0 +1,50 @@
+#ifndef _GGH_NATIVE_SERVO_H_
+#define _GGH_NATIVE_SERVO_H_
+
+#include "Arduino.h"
+
+#define MIN_PULSE_WIDTH      544
+#define MAX_PULSE_WIDTH     2400
+#define DEFAULT_PULSE_WIDTH 1500
+
+// Remembers the last pulse width instead of driving a pin.
+class Servo {
+public:
+  uint8_t attach(int pin) { _pin = pin; return 0; }
+  void detach() { _pin = -1; }
+  bool attached() { return _pin >= 0; }
+
+  void write(int value)
+  {
+    if (value < MIN_PULSE_WIDTH) {
+      if (value < 0) {
+        value = 0;
+      }
+      if (value > 180) {
+        value = 180;
+      }
+      value = MIN_PULSE_WIDTH + (long)value * (MAX_PULSE_WIDTH - MIN_PULSE_WIDTH) / 180;
+    }
+    writeMicroseconds(value);
+  }
+
+  void writeMicroseconds(int value)
+  {
+    if (value < MIN_PULSE_WIDTH) {
+      value = MIN_PULSE_WIDTH;
+    }
+    if (value > MAX_PULSE_WIDTH) {
+      value = MAX_PULSE_WIDTH;
+    }
+    _pulse = value;
+  }
+
+  int read() { return (long)(_pulse - MIN_PULSE_WIDTH) * 180 / (MAX_PULSE_WIDTH - MIN_PULSE_WIDTH); }
+  int readMicroseconds() { return _pulse; }
+
+private:
+  int _pin = -1;
+  int _pulse = DEFAULT_PULSE_WIDTH;
+};
+
+#endif // _GGH_NATIVE_SERVO_H_
@@ -0,0 +1,13 @@
+#ifndef _GGH_NATIVE_STREAM_H_
+#define _GGH_NATIVE_STREAM_H_
+
+#include "Print.h"
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+};
+
+#endif // _GGH_NATIVE_STREAM_H_
@@ -0,0 +1,299 @@
+#include "WString.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+
+static void format_integer(char *buf, unsigned long value, bool negative, unsigned char base)
+{
+  char tmp[8 * sizeof(long) + 2];
+  char *p = &tmp[sizeof(tmp) - 1];
+  *p = '\0';
+  if (base < 2) {
+    base = 10;
+  }
+  do {
+    unsigned long digit = value % base;
+    *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+    value /= base;
+  } while (value);
+  if (negative) {
+    *--p = '-';
+  }
+  strcpy(buf, p);
+}
+
+String::String(const char *cstr)
+{
+  init();
+  if (cstr) {
+    copy(cstr, strlen(cstr));
+  }
+}
+
+String::String(const String &str)
+{
+  init();
+  *this = str;
+}
+
+String::String(String &&rval)
+{
+  init();
+  move(rval);
+}
+
+String::String(const __FlashStringHelper *str)
+{
+  init();
+  const char *cstr = reinterpret_cast<const char *>(str);
+  if (cstr) {
+    copy(cstr, strlen(cstr));
+  }
+}
+
+String::String(char c)
+{
+  init();
+  char buf[2] = { c, '\0' };
+  copy(buf, 1);
+}
+
+String::String(unsigned char value, unsigned char base)
+{
+  init();
+  char buf[1 + 8 * sizeof(unsigned char)];
+  format_integer(buf, value, false, base);
+  copy(buf, strlen(buf));
+}
+
+String::String(int value, unsigned char base)
+{
+  init();
+  char buf[2 + 8 * sizeof(int)];
+  if (base == 10 && value < 0) {
+    format_integer(buf, -(long)value, true, base);
+  }
+  else {
+    format_integer(buf, (unsigned int)value, false, base);
+  }
+  copy(buf, strlen(buf));
+}
+
+String::String(unsigned int value, unsigned char base)
+{
+  init();
+  char buf[1 + 8 * sizeof(unsigned int)];
+  format_integer(buf, value, false, base);
+  copy(buf, strlen(buf));
+}
+
+String::String(long value, unsigned char base)
+{
+  init();
+  char buf[2 + 8 * sizeof(long)];
+  if (base == 10 && value < 0) {
+    format_integer(buf, -(unsigned long)value, true, base);
+  }
+  else {
+    format_integer(buf, (unsigned long)value, false, base);
+  }
+  copy(buf, strlen(buf));
+}
+
+String::String(unsigned long value, unsigned char base)
+{
+  init();
+  char buf[1 + 8 * sizeof(unsigned long)];
+  format_integer(buf, value, false, base);
+  copy(buf, strlen(buf));
+}
+
+String::String(float value, unsigned char decimalPlaces)
+  : String((double)value, decimalPlaces)
+{
+}
+
+String::String(double value, unsigned char decimalPlaces)
+{
+  // dtostrf(value, decimalPlaces + 2, decimalPlaces, buf) on the AVR core
+  init();
+  char buf[48];
+  snprintf(buf, sizeof(buf), "%*.*f", decimalPlaces + 2, decimalPlaces, value);
+  copy(buf, strlen(buf));
+}
+
+String::~String()
+{
+  if (_buffer) {
+    sim::heap::release(_buffer, _capacity + 1);
+  }
+}
+
+void String::init()
+{
+  _buffer = nullptr;
+  _capacity = _len = 0;
+}
+
+void String::invalidate()
+{
+  if (_buffer) {
+    sim::heap::release(_buffer, _capacity + 1);
+  }
+  _buffer = nullptr;
+  _capacity = _len = 0;
+}
+
+bool String::reserve(unsigned int size)
+{
+  if (_buffer && _capacity >= size) {
+    return true;
+  }
+  if (changeBuffer(size)) {
+    if (_len == 0) {
+      _buffer[0] = '\0';
+    }
+    return true;
+  }
+  return false;
+}
+
+bool String::changeBuffer(unsigned int maxStrLen)
+{
+  char *buffer = (char *)sim::heap::allocate(_buffer, _buffer ? _capacity + 1 : 0, maxStrLen + 1);
+  if (buffer) {
+    _buffer = buffer;
+    _capacity = maxStrLen;
+    return true;
+  }
+  return false;
+}
+
+String &String::copy(const char *cstr, unsigned int length)
+{
+  if (!reserve(length)) {
+    invalidate();
+    return *this;
+  }
+  _len = length;
+  memcpy(_buffer, cstr, length);
+  _buffer[length] = '\0';
+  return *this;
+}
+
+void String::move(String &rhs)
+{
+  if (_buffer) {
+    sim::heap::release(_buffer, _capacity + 1);
+  }
+  _buffer = rhs._buffer;
+  _capacity = rhs._capacity;
+  _len = rhs._len;
+  rhs._buffer = nullptr;
+  rhs._capacity = rhs._len = 0;
+}
+
+String &String::operator=(const String &rhs)
+{
+  if (this == &rhs) {
+    return *this;
+  }
+  if (rhs._buffer) {
+    copy(rhs._buffer, rhs._len);
+  }
+  else {
+    invalidate();
+  }
+  return *this;
+}
+
+String &String::operator=(String &&rval)
+{
+  if (this != &rval) {
+    move(rval);
+  }
+  return *this;
+}
+
+String &String::operator=(const char *cstr)
+{
+  if (cstr) {
+    copy(cstr, strlen(cstr));
+  }
+  else {
+    invalidate();
+  }
+  return *this;
+}
+
+bool String::concat(const char *cstr, unsigned int length)
+{
+  unsigned int newlen = _len + length;
+  if (!cstr) {
+    return false;
+  }
+  if (length == 0) {
+    return true;
+  }
+  if (!reserve(newlen)) {
+    return false;
+  }
+  memcpy(_buffer + _len, cstr, length);
+  _len = newlen;
+  _buffer[_len] = '\0';
+  return true;
+}
+
+bool String::concat(const String &str)
+{
+  return concat(str.c_str(), str._len);
+}
+
+bool String::concat(const char *cstr)
+{
+  return cstr ? concat(cstr, strlen(cstr)) : false;
+}
+
+bool String::concat(char c)
+{
+  return concat(&c, 1);
+}
+
+StringSumHelper &operator+(const StringSumHelper &lhs, const String &rhs)
+{
+  StringSumHelper &a = const_cast<StringSumHelper &>(lhs);
+  a.concat(rhs);
+  return a;
+}
+
+StringSumHelper &operator+(const StringSumHelper &lhs, const char *cstr)
+{
+  StringSumHelper &a = const_cast<StringSumHelper &>(lhs);
+  a.concat(cstr);
+  return a;
+}
+
+StringSumHelper &operator+(const StringSumHelper &lhs, char c)
+{
+  StringSumHelper &a = const_cast<StringSumHelper &>(lhs);
+  a.concat(c);
+  return a;
+}
+
+bool String::equals(const String &rhs) const
+{
+  return _len == rhs._len && strcmp(c_str(), rhs.c_str()) == 0;
+}
+
+bool String::equals(const char *cstr) const
+{
+  return strcmp(c_str(), cstr ? cstr : "") == 0;
+}
+
+char String::charAt(unsigned int index) const
+{
+  return index < _len ? _buffer[index] : '\0';
+}
@@ -0,0 +1,81 @@
+#ifndef _GGH_NATIVE_WSTRING_H_
+#define _GGH_NATIVE_WSTRING_H_
+
+// Heap backed String with the same allocation behaviour as the AVR core:
+// every temporary owns a malloc'd buffer and concatenation reallocs. Every
+// allocation is counted in sim::heap so benchmarks can report it.
+
+#include <stdint.h>
+#include <stddef.h>
+
+class __FlashStringHelper;
+class StringSumHelper;
+
+class String {
+public:
+  String(const char *cstr = "");
+  String(const String &str);
+  String(String &&rval);
+  String(const __FlashStringHelper *str);
+  explicit String(char c);
+  explicit String(unsigned char value, unsigned char base = 10);
+  explicit String(int value, unsigned char base = 10);
+  explicit String(unsigned int value, unsigned char base = 10);
+  explicit String(long value, unsigned char base = 10);
+  explicit String(unsigned long value, unsigned char base = 10);
+  explicit String(float value, unsigned char decimalPlaces = 2);
+  explicit String(double value, unsigned char decimalPlaces = 2);
+  ~String();
+
+  String &operator=(const String &rhs);
+  String &operator=(String &&rval);
+  String &operator=(const char *cstr);
+
+  bool reserve(unsigned int size);
+  unsigned int length() const { return _len; }
+  const char *c_str() const { return _buffer ? _buffer : ""; }
+
+  bool concat(const String &str);
+  bool concat(const char *cstr);
+  bool concat(const char *cstr, unsigned int length);
+  bool concat(char c);
+
+  String &operator+=(const String &rhs) { concat(rhs); return *this; }
+  String &operator+=(const char *cstr) { concat(cstr); return *this; }
+  String &operator+=(char c) { concat(c); return *this; }
+
+  // Like the AVR core, the first '+' copies the left hand side into a
+  // StringSumHelper and every further '+' appends to it in place.
+  friend StringSumHelper &operator+(const StringSumHelper &lhs, const String &rhs);
+  friend StringSumHelper &operator+(const StringSumHelper &lhs, const char *cstr);
+  friend StringSumHelper &operator+(const StringSumHelper &lhs, char c);
+
+  bool equals(const String &rhs) const;
+  bool equals(const char *cstr) const;
+  bool operator==(const String &rhs) const { return equals(rhs); }
+  bool operator==(const char *cstr) const { return equals(cstr); }
+  bool operator!=(const String &rhs) const { return !equals(rhs); }
+  bool operator!=(const char *cstr) const { return !equals(cstr); }
+
+  char charAt(unsigned int index) const;
+  char operator[](unsigned int index) const { return charAt(index); }
+
+private:
+  char *_buffer;
+  unsigned int _capacity;
+  unsigned int _len;
+
+  void init();
+  void invalidate();
+  bool changeBuffer(unsigned int maxStrLen);
+  String &copy(const char *cstr, unsigned int length);
+  void move(String &rhs);
+};
+
+class StringSumHelper : public String {
+public:
+  StringSumHelper(const String &s) : String(s) {}
+  StringSumHelper(const char *p) : String(p) {}
+};
+
+#endif // _GGH_NATIVE_WSTRING_H_
@@ -0,0 +1,44 @@
+// Entry point for the native environment: runs setup()/loop() against
+// simulated thermocouple boards, with stdin/stdout standing in for the
+// serial port. Commands can be typed or piped in, e.g.
+//
+//   echo "T ONESHOT;" | .pioenvs/native/program
+
+#include "Arduino.h"
+
+#include <poll.h>
+#include <unistd.h>
+
+#include "sim.h"
+
+static const uint8_t chip_selects[] = { 10, 9, 8, 7, 6, 5, 4, 3 };
+
+static void pump_stdin()
+{
+  struct pollfd fd = { STDIN_FILENO, POLLIN, 0 };
+  if (poll(&fd, 1, 0) > 0 && (fd.revents & POLLIN)) {
+    uint8_t buf[64];
+    ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+    if (n > 0) {
+      sim::serial::feed(buf, (size_t)n);
+    }
+  }
+}
+
+int main()
+{
+  for (uint8_t i = 0; i < sizeof(chip_selects); i++) {
+    sim::max31855::attach(chip_selects[i], 21.5 + i * 12.25, 24.0625);
+  }
+  sim::max31855::set_fault(chip_selects[3], sim::max31855::OPEN);
+
+  setup();
+  // the board's link speed, so streaming paces itself like it does there
+  sim::serial::set_line_rate(115200);
+  for (;;) {
+    pump_stdin();
+    loop();
+    Serial.flush();
+  }
+  return 0;
+}
@@ -0,0 +1,13 @@
+#ifndef _GGH_NATIVE_AVR_EEPROM_H_
+#define _GGH_NATIVE_AVR_EEPROM_H_
+
+// Last EEPROM address, as avr/io.h has it for the ATmega328P.
+#define E2END 0x3FF
+
+// A byte write keeps the EEPROM busy for 3.3 ms, as on the ATmega328P.
+// Reads and writes started while busy wait for it, like eeprom_read_byte()
+// and eeprom_write_byte() do.
+
+bool eeprom_is_ready();
+
+#endif // _GGH_NATIVE_AVR_EEPROM_H_
@@ -0,0 +1,23 @@
+#ifndef _GGH_NATIVE_PGMSPACE_H_
+#define _GGH_NATIVE_PGMSPACE_H_
+
+// There is only one address space on the host, so flash reads are plain loads.
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+
+#define pgm_read_byte(addr)  (*(const uint8_t *)(addr))
+#define pgm_read_word(addr)  (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+
+#define strlen_P strlen
+#define memcpy_P memcpy
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(PSTR(string_literal)))
+
+#endif // _GGH_NATIVE_PGMSPACE_H_
@@ -0,0 +1,37 @@
+#include "sim.h"
+
+#include <stdlib.h>
+
+static sim::heap::stats heap_stats;
+
+const sim::heap::stats &sim::heap::get()
+{
+  return heap_stats;
+}
+
+void sim::heap::reset()
+{
+  heap_stats.allocations = 0;
+  heap_stats.frees = 0;
+  heap_stats.peak_bytes = heap_stats.live_bytes;
+}
+
+void *sim::heap::allocate(void *ptr, size_t old_size, size_t new_size)
+{
+  void *result = realloc(ptr, new_size);
+  if (result) {
+    heap_stats.allocations++;
+    heap_stats.live_bytes += new_size - old_size;
+    if (heap_stats.live_bytes > heap_stats.peak_bytes) {
+      heap_stats.peak_bytes = heap_stats.live_bytes;
+    }
+  }
+  return result;
+}
+
+void sim::heap::release(void *ptr, size_t size)
+{
+  free(ptr);
+  heap_stats.frees++;
+  heap_stats.live_bytes -= size;
+}
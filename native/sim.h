@@ -0,0 +1,99 @@
+#ifndef _GGH_NATIVE_SIM_H_
+#define _GGH_NATIVE_SIM_H_
+
+// Controls for the simulated hardware behind the native Arduino core. Host
+// programs (the native runner and the benchmarks) use these to attach fake
+// MAX31855 chips to chip-select pins, feed serial input and inspect what the
+// firmware wrote.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+namespace sim {
+
+  namespace heap {
+    struct stats {
+      uint64_t allocations;
+      uint64_t frees;
+      size_t live_bytes;
+      size_t peak_bytes;
+    };
+
+    const stats &get();
+    void reset();
+
+    // Used by the String implementation.
+    void *allocate(void *ptr, size_t old_size, size_t new_size);
+    void release(void *ptr, size_t size);
+  };
+
+  namespace serial {
+    enum class output {
+      console,  // stdout
+      capture,  // kept in memory, see captured()
+      discard   // only counted
+    };
+
+    void set_output(output mode);
+    void feed(const char *bytes);
+    void feed(const uint8_t *bytes, size_t length);
+    const std::string &captured();
+    void clear_captured();
+    uint64_t tx_bytes();
+
+    // Drains TX at baud / 10 bytes per second from a 63 byte buffer, so
+    // availableForWrite() drops and writes block like on the board. 0, the
+    // default, is an infinitely fast link.
+    void set_line_rate(unsigned long baud);
+    // Writes that found the TX buffer full, and the time they spent waiting.
+    uint64_t tx_waits();
+    uint64_t tx_blocked_us();
+  };
+
+  namespace max31855 {
+    enum fault : uint8_t {
+      OPEN      = 0x01,
+      SHORT_GND = 0x02,
+      SHORT_VCC = 0x04
+    };
+
+    // Frame layout from the datasheet: 14-bit thermocouple temperature in
+    // 0.25 C steps at D31..D18, fault flag at D16, 12-bit junction
+    // temperature in 0.0625 C steps at D15..D4 and the fault bits at D2..D0.
+    uint32_t encode(double thermocouple, double junction, uint8_t faults = 0);
+
+    void attach(uint8_t chip_select, double thermocouple, double junction);
+    void detach(uint8_t chip_select);
+    void set_temperature(uint8_t chip_select, double thermocouple, double junction);
+    void set_fault(uint8_t chip_select, uint8_t faults);
+
+    // What MISO reads back when no chip answers on the selected pin.
+    void set_floating_level(uint8_t level);
+
+    uint64_t frames_read(uint8_t chip_select);
+    uint64_t frames_read();
+    // Reads that interrupted a conversion and got the previous result again.
+    uint64_t stale_frames_read();
+  };
+
+  namespace eeprom {
+    uint64_t writes();
+    // Reads and writes that had to wait for a write still in progress.
+    uint64_t waits();
+    void erase();
+  };
+
+  namespace clock {
+    // Shifts micros()/millis() forward, e.g. to exercise 32-bit wraparound.
+    void advance_micros(uint64_t us);
+  };
+
+  // Called by the core for every SPI byte and chip-select edge.
+  namespace bus {
+    void chip_select(uint8_t pin, uint8_t level);
+    uint8_t transfer(uint8_t out);
+  };
+};
+
+#endif // _GGH_NATIVE_SIM_H_
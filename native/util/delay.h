@@ -0,0 +1,9 @@
+#ifndef _GGH_NATIVE_UTIL_DELAY_H_
+#define _GGH_NATIVE_UTIL_DELAY_H_
+
+// Busy waits, like avr-libc, so the cost shows up in host benchmarks.
+
+void _delay_ms(double ms);
+void _delay_us(double us);
+
+#endif // _GGH_NATIVE_UTIL_DELAY_H_
@@ -0,0 +1,77 @@
+#include "alarm.h"
+
+safety::Alarm::Alarm()
+{
+  _high = 0;
+  _low = 0;
+  _rise = 0;
+  _hysteresis = 0;
+  _armed = 0;
+  _trips = 0;
+  _active = 0;
+  _primed = false;
+  _window_value = 0;
+  _window_time = 0;
+  _rate = 0;
+}
+
+void safety::Alarm::configure(int16_t high, int16_t low, uint8_t rise, uint8_t hysteresis)
+{
+  _high = high;
+  _low = low;
+  _rise = rise;
+  _hysteresis = hysteresis;
+}
+
+void safety::Alarm::arm(uint8_t armed, uint8_t trips)
+{
+  _armed = armed & ALL;
+  _trips = trips & _armed;
+  _active &= _armed;
+}
+
+// Sets or clears bit in active by the raise and clear tests.
+static uint8_t latch(uint8_t active, uint8_t bit, bool raise, bool clear)
+{
+  if (raise) {
+    return active | bit;
+  }
+  if (clear) {
+    return active & ~bit;
+  }
+  return active;
+}
+
+uint8_t safety::Alarm::update(uint32_t time, bool ok, int16_t value)
+{
+  uint8_t active = _active;
+
+  if (!ok) {
+    _primed = false;
+    active |= FAULT;
+  }
+  else {
+    active &= ~FAULT;
+
+    int32_t v = value;
+    active = latch(active, OVER, v > _high, v < (int32_t)_high - _hysteresis);
+    active = latch(active, UNDER, v < _low, v > (int32_t)_low + _hysteresis);
+
+    if (!_primed) {
+      _primed = true;
+      _window_value = value;
+      _window_time = time;
+    }
+    else if (time - _window_time >= RATE_WINDOW_MS) {
+      _rate = (int16_t)((v - _window_value) * 1000 / (int32_t)(time - _window_time));
+      _window_value = value;
+      _window_time = time;
+      active = latch(active, RISE, _rate > _rise, _rate < (int16_t)_rise - _hysteresis);
+    }
+  }
+
+  active &= _armed;
+  uint8_t changed = active ^ _active;
+  _active = active;
+  return changed;
+}
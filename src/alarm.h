@@ -0,0 +1,73 @@
+#ifndef _GGH_ALARM_H_
+#define _GGH_ALARM_H_
+
+#include "stdint.h"
+#include "Arduino.h"
+
+namespace safety {
+
+  // Alarm conditions, one bit each in the armed, trip and active masks.
+  static const uint8_t OVER  = 0x01;  // above the high threshold
+  static const uint8_t UNDER = 0x02;  // below the low threshold
+  static const uint8_t RISE  = 0x04;  // rising faster than the rate limit
+  static const uint8_t FAULT = 0x08;  // thermocouple open or shorted, or no chip
+  static const uint8_t ALL   = 0x0f;
+
+  // Threshold alarms for one channel. Thresholds and hysteresis are 0.25 C
+  // counts (see fixed_point.h) and the rate limit counts per second. A
+  // condition is raised once the reading crosses its threshold and cleared
+  // only once it is back by more than the hysteresis, so a reading sitting
+  // on a threshold does not chatter. The rate of rise is taken over
+  // RATE_WINDOW_MS, long enough for the 0.25 C steps of the chip to mean
+  // something; the hysteresis applies to it in counts per second.
+  //
+  // Only armed conditions are evaluated. The trip mask picks the armed
+  // conditions that should also act on the door; what that means is up to
+  // the caller. update() is a handful of compares and one division per
+  // window, and the object is 18 bytes.
+  class Alarm {
+  public:
+    static const uint16_t RATE_WINDOW_MS = 1000;
+
+    Alarm();
+
+    void configure(int16_t high, int16_t low, uint8_t rise, uint8_t hysteresis);
+    // Disarmed conditions are cleared without an event.
+    void arm(uint8_t armed, uint8_t trips);
+
+    int16_t high() const { return _high; }
+    int16_t low() const { return _low; }
+    uint8_t rise() const { return _rise; }
+    uint8_t hysteresis() const { return _hysteresis; }
+    uint8_t armed() const { return _armed; }
+    uint8_t trips() const { return _trips; }
+
+    // Conditions raised right now.
+    uint8_t active() const { return _active; }
+    // Rate over the last complete window, counts per second.
+    int16_t rate() const { return _rate; }
+
+    // Evaluates one reading taken at time (millis()). ok is false for a
+    // faulted reading, whose value is ignored; the value conditions then
+    // keep their state and the rate starts over. Returns the conditions
+    // that were raised or cleared.
+    uint8_t update(uint32_t time, bool ok, int16_t value);
+
+  private:
+    int16_t _high;
+    int16_t _low;
+    uint8_t _rise;
+    uint8_t _hysteresis;
+    uint8_t _armed;
+    uint8_t _trips;
+    uint8_t _active;
+
+    // start of the current rate window
+    bool _primed;
+    int16_t _window_value;
+    uint32_t _window_time;
+    int16_t _rate;
+  };
+};
+
+#endif // _GGH_ALARM_H_
@@ -0,0 +1,100 @@
+#include "binary_frame.h"
+
+uint16_t protocol::binary::crc16(const uint8_t *data, size_t length, uint16_t crc)
+{
+  while (length--) {
+    crc ^= (uint16_t)(*data++) << 8;
+    for (uint8_t i = 0; i < 8; i++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+size_t protocol::binary::write_cobs(Print &out, const uint8_t *data, size_t length)
+{
+  // Each block is a code byte (distance to the next zero, at most 0xff)
+  // followed by the non-zero bytes it covers, so nothing needs buffering.
+  size_t n = 0;
+  size_t start = 0;
+  for (;;) {
+    size_t end = start;
+    while (end < length && data[end] != 0 && end - start < 0xfe) {
+      end++;
+    }
+    uint8_t code = (uint8_t)(end - start + 1);
+    n += out.write(code);
+    n += out.write(&data[start], end - start);
+
+    if (end == length) {
+      break;
+    }
+    // a zero in the data is implied by the code byte, a full block is not
+    start = data[end] == 0 ? end + 1 : end;
+  }
+  n += out.write((uint8_t)0x00);
+  return n;
+}
+
+protocol::binary::Frame::Frame(frame_type type)
+{
+  _data[0] = static_cast<uint8_t>(type);
+  _length = 1;
+}
+
+uint8_t *protocol::binary::Frame::reserve(uint8_t length)
+{
+  if (_length + length > 1 + MAX_PAYLOAD) {
+    return NULL;
+  }
+  uint8_t *p = &_data[_length];
+  _length += length;
+  return p;
+}
+
+bool protocol::binary::Frame::add(uint8_t value)
+{
+  uint8_t *p = reserve(1);
+  if (!p) {
+    return false;
+  }
+  p[0] = value;
+  return true;
+}
+
+bool protocol::binary::Frame::add(uint16_t value)
+{
+  uint8_t *p = reserve(2);
+  if (!p) {
+    return false;
+  }
+  p[0] = (uint8_t)value;
+  p[1] = (uint8_t)(value >> 8);
+  return true;
+}
+
+bool protocol::binary::Frame::add(int16_t value)
+{
+  return add((uint16_t)value);
+}
+
+bool protocol::binary::Frame::add(uint32_t value)
+{
+  uint8_t *p = reserve(4);
+  if (!p) {
+    return false;
+  }
+  p[0] = (uint8_t)value;
+  p[1] = (uint8_t)(value >> 8);
+  p[2] = (uint8_t)(value >> 16);
+  p[3] = (uint8_t)(value >> 24);
+  return true;
+}
+
+size_t protocol::binary::Frame::write(Print &out)
+{
+  uint16_t crc = crc16(_data, _length);
+  _data[_length] = (uint8_t)crc;
+  _data[_length + 1] = (uint8_t)(crc >> 8);
+  return write_cobs(out, _data, _length + 2);
+}
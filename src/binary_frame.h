@@ -0,0 +1,81 @@
+#ifndef _GGH_BINARY_FRAME_H_
+#define _GGH_BINARY_FRAME_H_
+
+#include "stdint.h"
+#include "Arduino.h"
+
+// Binary streaming format (T S2 / S2).
+//
+// Every frame is COBS encoded and terminated by a single 0x00, so a host
+// can resynchronise on any zero byte. Decoded, a frame is
+//
+//   type (u8) | payload | crc16 (u16)
+//
+// where the CRC is CRC-16/CCITT-FALSE (poly 0x1021, init 0xffff) over type
+// and payload. All multi-byte fields are little endian.
+//
+//   TEMPERATURE: sequence (u32) | count (u8), then count channel records of
+//                channel (u8) | status code (i8) |
+//                thermocouple (i16, 14-bit raw, 0.25 C per bit) |
+//                junction (i16, 12-bit raw, 0.0625 C per bit) |
+//                corrected (i16, NIST linearized, 0.0625 C per bit) |
+//                time (u32, millis() when the chip was read)
+//   DOOR:        sequence (u32) | state (u8, 0 closed, 1 open, 2 closing,
+//                3 opening, 4 under temperature control) | position (u16,
+//                where the door is now, in the units of D C)
+//   CONTROL:     sequence (u32) | flags (u8, bit 0 enabled, bit 1 input
+//                valid) | setpoint (i16, 0.25 C per bit) | input (i16,
+//                0.25 C per bit) | output (i16, permille of door travel) |
+//                p | i | d (i16 each, permille)
+//   ALARM:       channel (u8) | condition (u8, 1 over, 2 under, 4 rise,
+//                8 fault) | active (u8, 1 raised, 0 cleared) | status
+//                code (i8) | thermocouple (i16, 0.25 C per bit) | time
+//                (u32, millis() of the reading)
+//
+// The sequence number counts streamed frames, one per stream period that
+// sent anything; the temperature, door and control frames of one period
+// share it.
+// A gap means frames were lost on the way (see the C command). ALARM frames
+// are sent out of band, between or ahead of the others, and carry no
+// sequence number.
+
+namespace protocol {
+  namespace binary {
+
+    enum class frame_type : uint8_t {
+      TEMPERATURE = 0x01,
+      DOOR        = 0x02,
+      CONTROL     = 0x03,
+      ALARM       = 0x04
+    };
+
+    uint16_t crc16(const uint8_t *data, size_t length, uint16_t crc = 0xffff);
+
+    // COBS encodes length bytes from data to out, followed by the 0x00
+    // delimiter. Returns the number of bytes written.
+    size_t write_cobs(Print &out, const uint8_t *data, size_t length);
+
+    // Assembles one frame in a fixed buffer and writes it framed to a sink.
+    class Frame {
+    public:
+      static const uint8_t MAX_PAYLOAD = 104;
+
+      explicit Frame(frame_type type);
+
+      bool add(uint8_t value);
+      bool add(int16_t value);
+      bool add(uint16_t value);
+      bool add(uint32_t value);
+      // Reserves length bytes and returns them for the caller to fill.
+      uint8_t *reserve(uint8_t length);
+
+      size_t write(Print &out);
+
+    private:
+      uint8_t _data[1 + MAX_PAYLOAD + 2];
+      uint8_t _length;
+    };
+  };
+};
+
+#endif // _GGH_BINARY_FRAME_H_
@@ -0,0 +1,63 @@
+#ifndef _GGH_BUFFER_PRINT_H_
+#define _GGH_BUFFER_PRINT_H_
+
+#include "stdint.h"
+#include "Arduino.h"
+
+// Print sink over a caller owned, fixed size char buffer. Output that does
+// not fit is dropped; the buffer is always NUL terminated.
+class BufferPrint : public Print {
+public:
+  BufferPrint(char *buffer, size_t size) : _buffer(buffer), _size(size), _length(0)
+  {
+    if (_size > 0) {
+      _buffer[0] = '\0';
+    }
+  }
+
+  virtual size_t write(uint8_t c)
+  {
+    if (_length + 1 >= _size) {
+      return 0;
+    }
+    _buffer[_length++] = c;
+    _buffer[_length] = '\0';
+    return 1;
+  }
+
+  using Print::write;
+
+  size_t length() const { return _length; }
+
+private:
+  char *_buffer;
+  size_t _size;
+  size_t _length;
+};
+
+// Print sink that only counts, e.g. to size output before producing it.
+class CountingPrint : public Print {
+public:
+  CountingPrint() : _count(0) {}
+
+  virtual size_t write(uint8_t)
+  {
+    _count++;
+    return 1;
+  }
+
+  virtual size_t write(const uint8_t *, size_t size)
+  {
+    _count += size;
+    return size;
+  }
+
+  using Print::write;
+
+  size_t count() const { return _count; }
+
+private:
+  size_t _count;
+};
+
+#endif // _GGH_BUFFER_PRINT_H_
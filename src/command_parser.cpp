@@ -0,0 +1,196 @@
+#include "command_parser.h"
+
+#include "stdlib.h"
+
+static inline bool is_separator(char c)
+{
+  return c == ' ' || c == '\t' || c == '\r' || c == ',';
+}
+
+static inline bool is_letter(char c)
+{
+  return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+}
+
+static inline bool starts_number(char c)
+{
+  return (c >= '0' && c <= '9') || c == '-';
+}
+
+const __FlashStringHelper *command::error_message(error code)
+{
+  switch (code) {
+    case error::NONE: return F("ok");
+    case error::UNKNOWN_COMMAND: return F("unknown command");
+    case error::UNKNOWN_SUBCOMMAND: return F("unknown sub-command");
+    case error::MISSING_ARGUMENT: return F("missing argument");
+    case error::INVALID_ARGUMENT: return F("invalid argument");
+    case error::INVALID_CHANNEL: return F("invalid channel");
+    case error::LINE_TOO_LONG: return F("line too long");
+    case error::TOO_MANY_TOKENS: return F("too many tokens");
+    case error::INVALID_STATE: return F("invalid state");
+    case error::BUSY: return F("busy");
+    default: return F("");
+  }
+}
+
+size_t command::print_error(Print &out, error code, long id)
+{
+  size_t n = 0;
+  n += out.print(F("{ \"error\": {"));
+  if (id != NO_REQUEST) {
+    n += out.print(F("\"id\": "));
+    n += out.print(id, DEC);
+    n += out.print(F(", "));
+  }
+  n += out.print(F("\"code\": "));
+  n += out.print(static_cast<uint8_t>(code), DEC);
+  n += out.print(F(", \"message\": \""));
+  n += out.print(error_message(code));
+  n += out.println(F("\"}}"));
+  return n;
+}
+
+size_t command::print_ack(Print &out, error code, long id)
+{
+  if (code != error::NONE) {
+    return print_error(out, code, id);
+  }
+  size_t n = 0;
+  n += out.print(F("{ \"ack\": {\"id\": "));
+  n += out.print(id, DEC);
+  n += out.println(F("}}"));
+  return n;
+}
+
+command::Args command::Args::shift(uint8_t n) const
+{
+  if (n >= _count) {
+    return Args(NULL, 0);
+  }
+  return Args(_tokens + n, _count - n);
+}
+
+command::error command::Args::integer(uint8_t i, long min, long max, long &value) const
+{
+  const char *token = at(i);
+  if (!token) {
+    return error::MISSING_ARGUMENT;
+  }
+  char *end;
+  long parsed = strtol(token, &end, 10);
+  if (end == token || *end != '\0' || parsed < min || parsed > max) {
+    return error::INVALID_ARGUMENT;
+  }
+  value = parsed;
+  return error::NONE;
+}
+
+command::error command::Args::request(long &id)
+{
+  id = NO_REQUEST;
+  const char *name = at(0);
+  if (!name || name[0] != 'N' || name[1] != '\0') {
+    return error::NONE;
+  }
+  long value;
+  error status = integer(1, 0, MAX_REQUEST_ID, value);
+  if (status != error::NONE) {
+    return error::INVALID_ARGUMENT;
+  }
+  id = value;
+  *this = shift(2);
+  return error::NONE;
+}
+
+command::Parser::Parser()
+{
+  reset();
+}
+
+void command::Parser::reset()
+{
+  _length = 0;
+  _token_count = 0;
+  _in_token = false;
+  _complete = false;
+  _status = error::NONE;
+}
+
+bool command::Parser::feed(char c)
+{
+  if (_complete) {
+    reset();
+  }
+
+  if (c == '\n' || c == ';') {
+    if (_token_count == 0 && _status == error::NONE) {
+      reset();
+      return false;     // blank command
+    }
+    _line[_length] = '\0';
+    _complete = true;
+    return true;
+  }
+
+  if (_status != error::NONE) {
+    return false;       // discard the rest of a bad command
+  }
+
+  if (is_separator(c)) {
+    if (_in_token) {
+      _line[_length++] = '\0';
+      _in_token = false;
+    }
+    return false;
+  }
+
+  // a letter followed by a number starts a new token: "E0" -> "E" "0"
+  bool split = _in_token && starts_number(c) && is_letter(_line[_length - 1]);
+
+  // room for the character, a terminator for a split and the final one
+  if (_length + (split ? 2 : 1) >= MAX_LINE_LENGTH) {
+    _status = error::LINE_TOO_LONG;
+    return false;
+  }
+  if (split) {
+    _line[_length++] = '\0';
+    _in_token = false;
+  }
+  if (!_in_token) {
+    if (_token_count == MAX_TOKENS) {
+      _status = error::TOO_MANY_TOKENS;
+      return false;
+    }
+    _tokens[_token_count++] = &_line[_length];
+    _in_token = true;
+  }
+  _line[_length++] = c;
+  return false;
+}
+
+command::error command::dispatch(const entry *table, uint8_t size, const Args &args)
+{
+  const char *name = args.at(0);
+  if (!name || name[1] != '\0') {
+    return error::UNKNOWN_COMMAND;
+  }
+
+  const char *sub = args.at(1);
+  bool known = false;
+  for (uint8_t i = 0; i < size; i++) {
+    entry e;
+    memcpy_P(&e, &table[i], sizeof(e));
+    if (e.command != name[0]) {
+      continue;
+    }
+    known = true;
+    if (e.sub_command == 0) {
+      return e.run(args.shift(1));
+    }
+    if (sub && sub[0] == e.sub_command) {
+      return e.run(args.shift(2));
+    }
+  }
+  return known ? error::UNKNOWN_SUBCOMMAND : error::UNKNOWN_COMMAND;
+}
@@ -0,0 +1,115 @@
+#ifndef _GGH_COMMAND_PARSER_H_
+#define _GGH_COMMAND_PARSER_H_
+
+#include "stdint.h"
+#include "Arduino.h"
+
+// Serial command parsing.
+//
+// Bytes are tokenized as they arrive, so finishing a line costs the same
+// however long it is. A command ends at '\n' or ';'. Tokens are split on
+// spaces, tabs, '\r' and ',', and also where a letter is directly followed
+// by a digit or '-', so "T E0", "T E 0", "S1 500" and "S 1 500" tokenize
+// the same way.
+//
+// Commands are looked up in a table of { command, sub-command, handler }
+// entries. The command is the first token. The sub-command, if the entry
+// has one, is the first character of the second token, so "T ONESHOT"
+// matches 'T'/'O'. The handler gets the remaining tokens as Args.
+//
+// A command may be prefixed with a request id, G-code style: "N12 T E0".
+// It is answered with an acknowledgement carrying the id once it has run,
+// or with its error tagged with the id. An id on its own, "N12", runs
+// nothing and is acknowledged once everything before it has run. Commands
+// without an id are not acknowledged.
+namespace command {
+
+  static const uint8_t MAX_LINE_LENGTH = 48;
+  static const uint8_t MAX_TOKENS = 8;
+  static const long MAX_REQUEST_ID = 65535;
+  static const long NO_REQUEST = -1;
+
+  enum class error : uint8_t {
+    NONE               = 0,
+    UNKNOWN_COMMAND    = 1,
+    UNKNOWN_SUBCOMMAND = 2,
+    MISSING_ARGUMENT   = 3,
+    INVALID_ARGUMENT   = 4,
+    INVALID_CHANNEL    = 5,
+    LINE_TOO_LONG      = 6,
+    TOO_MANY_TOKENS    = 7,
+    INVALID_STATE      = 8,
+    // Not an answer: the handler printed nothing and wants to be run again
+    // later, e.g. a read before the first reading is in.
+    BUSY               = 9
+  };
+
+  const __FlashStringHelper *error_message(error code);
+
+  // { "error": {"code": 5, "message": "invalid channel"} }, with
+  // "id": 12 first when the command had a request id.
+  size_t print_error(Print &out, error code, long id = NO_REQUEST);
+
+  // { "ack": {"id": 12}} for a command that succeeded, otherwise its error.
+  size_t print_ack(Print &out, error code, long id);
+
+  class Args {
+  public:
+    Args() : _tokens(NULL), _count(0) {}
+    Args(const char *const *tokens, uint8_t count) : _tokens(tokens), _count(count) {}
+
+    uint8_t count() const { return _count; }
+    const char *at(uint8_t i) const { return i < _count ? _tokens[i] : NULL; }
+    Args shift(uint8_t n) const;
+
+    // Parses argument i as a decimal integer within [min, max]. Returns
+    // NONE, MISSING_ARGUMENT or INVALID_ARGUMENT.
+    error integer(uint8_t i, long min, long max, long &value) const;
+
+    // Takes a leading request id off the arguments. Sets id to it, or to
+    // NO_REQUEST if there is none. Returns INVALID_ARGUMENT for an "N"
+    // without a valid id, which is then left in place.
+    error request(long &id);
+
+  private:
+    const char *const *_tokens;
+    uint8_t _count;
+  };
+
+  typedef error (*handler)(const Args &args);
+
+  struct entry {
+    char command;
+    char sub_command;   // 0 when the command takes arguments directly
+    handler run;
+  };
+
+  class Parser {
+  public:
+    Parser();
+
+    // Consumes one byte. Returns true when it completed a non-empty command,
+    // which is then available from args() and status() until the next feed().
+    bool feed(char c);
+
+    const Args args() const { return Args(_tokens, _token_count); }
+    // NONE, or LINE_TOO_LONG / TOO_MANY_TOKENS if the command was truncated.
+    error status() const { return _status; }
+
+  private:
+    char _line[MAX_LINE_LENGTH + 1];
+    const char *_tokens[MAX_TOKENS];
+    uint8_t _length;
+    uint8_t _token_count;
+    bool _in_token;
+    bool _complete;
+    error _status;
+
+    void reset();
+  };
+
+  // Finds the entry for args in a PROGMEM table and runs it.
+  error dispatch(const entry *table, uint8_t size, const Args &args);
+};
+
+#endif // _GGH_COMMAND_PARSER_H_
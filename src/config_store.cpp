@@ -0,0 +1,145 @@
+#include "config_store.h"
+#include "binary_frame.h"
+
+#include "EEPROM.h"
+
+storage::ConfigStore::ConfigStore(void *config, uint8_t size, uint8_t version, uint16_t base, uint8_t slots)
+{
+  _config = (uint8_t *)config;
+  _size = size;
+  _version = version;
+  _base = base;
+  _slots = slots;
+  _slot = slots - 1;
+  _sequence = 0xffff;
+  _dirty = false;
+  _changed = 0;
+  _writing = false;
+  _position = 0;
+  _crc = 0;
+}
+
+uint16_t storage::ConfigStore::slotAddress(uint8_t slot) const
+{
+  return _base + (uint16_t)slot * slotLength();
+}
+
+uint16_t storage::ConfigStore::checksum(uint16_t sequence) const
+{
+  uint8_t header[3] = { _version, (uint8_t)sequence, (uint8_t)(sequence >> 8) };
+  return protocol::binary::crc16(header, sizeof(header));
+}
+
+bool storage::ConfigStore::load()
+{
+  bool found = false;
+
+  // checked straight from EEPROM; only the winning slot is copied
+  for (uint8_t slot = 0; slot < _slots; slot++) {
+    uint16_t address = slotAddress(slot);
+    uint16_t sequence = EEPROM.read(address) | (EEPROM.read(address + 1) << 8);
+    uint16_t crc = checksum(sequence);
+    for (uint8_t i = 0; i < _size; i++) {
+      uint8_t value = EEPROM.read(address + 2 + i);
+      crc = protocol::binary::crc16(&value, 1, crc);
+    }
+    uint16_t stored = EEPROM.read(address + 2 + _size) | (EEPROM.read(address + 3 + _size) << 8);
+
+    if (crc != stored) {
+      continue;
+    }
+    // sequences wrap, so newer means ahead by less than half the range
+    if (!found || (int16_t)(sequence - _sequence) > 0) {
+      found = true;
+      _slot = slot;
+      _sequence = sequence;
+    }
+  }
+
+  if (found) {
+    for (uint8_t i = 0; i < _size; i++) {
+      _config[i] = EEPROM.read(slotAddress(_slot) + 2 + i);
+    }
+  }
+  return found;
+}
+
+void storage::ConfigStore::markDirty()
+{
+  _dirty = true;
+  _changed = millis();
+  _writing = false;
+}
+
+uint8_t storage::ConfigStore::imageByte(uint8_t i) const
+{
+  uint16_t sequence = _sequence + 1;
+  if (i < 2) {
+    return i == 0 ? sequence : sequence >> 8;
+  }
+  if (i < 2 + _size) {
+    return _config[i - 2];
+  }
+  return i == 2 + _size ? _crc : _crc >> 8;
+}
+
+void storage::ConfigStore::begin()
+{
+  _writing = true;
+  _dirty = false;
+  _position = 0;
+  _crc = protocol::binary::crc16(_config, _size, checksum(_sequence + 1));
+}
+
+// Writes the next byte that differs from the slot. Returns true once the
+// whole slot matches the image.
+bool storage::ConfigStore::step()
+{
+  uint16_t address = slotAddress((_slot + 1) % _slots);
+  while (_position < slotLength()) {
+    uint8_t value = imageByte(_position);
+    if (EEPROM.read(address + _position) != value) {
+      EEPROM.write(address + _position, value);
+      _position++;
+      return _position == slotLength();
+    }
+    _position++;
+  }
+  return true;
+}
+
+void storage::ConfigStore::finish()
+{
+  _writing = false;
+  _slot = (_slot + 1) % _slots;
+  _sequence++;
+}
+
+void storage::ConfigStore::poll()
+{
+  if (!_writing) {
+    if (!_dirty || millis() - _changed < COMMIT_DELAY_MS) {
+      return;
+    }
+    begin();
+  }
+  if (!eeprom_is_ready()) {
+    return;
+  }
+  if (step()) {
+    finish();
+  }
+}
+
+void storage::ConfigStore::flush()
+{
+  if (!_writing) {
+    if (!_dirty) {
+      return;
+    }
+    begin();
+  }
+  while (!step()) {
+  }
+  finish();
+}
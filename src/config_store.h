@@ -0,0 +1,75 @@
+#ifndef _GGH_CONFIG_STORE_H_
+#define _GGH_CONFIG_STORE_H_
+
+#include "stdint.h"
+#include "Arduino.h"
+
+namespace storage {
+
+  // Keeps a packed config struct in EEPROM, in a ring of slots laid out as
+  //
+  //   sequence (u16) | config | crc16 (u16)
+  //
+  // where the CRC (see binary_frame.h) covers the layout version, sequence
+  // and config. load() takes the valid slot with the newest sequence, so a
+  // version bump or a torn write falls back to defaults or to the previous
+  // slot.
+  //
+  // Changes are only marked in RAM. Once the config has been left alone for
+  // COMMIT_DELAY_MS, poll() writes it to the next slot one byte at a time,
+  // and only while the EEPROM is idle, so a commit never blocks the caller.
+  // Bytes the slot already holds are skipped.
+  class ConfigStore {
+  public:
+    ConfigStore(void *config, uint8_t size, uint8_t version, uint16_t base, uint8_t slots);
+
+    // Reads the newest valid slot into the config. Returns false, leaving
+    // the config untouched, if there is none.
+    bool load();
+
+    void markDirty();
+    bool dirty() const { return _dirty || _writing; }
+
+    // Call from loop().
+    void poll();
+    // Finishes any pending commit, blocking on every byte.
+    void flush();
+
+    uint8_t slot() const { return _slot; }
+    uint16_t sequence() const { return _sequence; }
+
+    static const uint16_t COMMIT_DELAY_MS = 1000;
+    // sequence and crc around the config in each slot
+    static const uint8_t SLOT_OVERHEAD = 4;
+
+  private:
+    uint8_t *_config;
+    uint8_t _size;
+    uint8_t _version;
+    uint16_t _base;
+    uint8_t _slots;
+
+    uint8_t _slot;          // last committed slot
+    uint16_t _sequence;     // and its sequence
+    bool _dirty;
+    uint32_t _changed;
+
+    // commit in progress, to slot _slot + 1. A change while it runs
+    // abandons it; the slot it was writing is then invalid until the next
+    // commit, which starts over on the same slot.
+    bool _writing;
+    uint8_t _position;
+    uint16_t _crc;
+
+    uint16_t slotAddress(uint8_t slot) const;
+    uint8_t slotLength() const { return _size + SLOT_OVERHEAD; }
+    // CRC of the version and sequence, to continue over the config
+    uint16_t checksum(uint16_t sequence) const;
+    uint8_t imageByte(uint8_t i) const;
+    void begin();
+    bool step();
+    void finish();
+  };
+};
+
+#endif // _GGH_CONFIG_STORE_H_
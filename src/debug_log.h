@@ -0,0 +1,73 @@
+#ifndef _GGH_DEBUG_LOG_H_
+#define _GGH_DEBUG_LOG_H_
+
+#include "stdint.h"
+#include "string.h"
+#include "Arduino.h"
+
+// "# ..." debug lines printed while frames may be going out. Streamed
+// frames are sent a piece at a time, so a line printed straight to Serial
+// can land in the middle of one. Lines are collected here instead and
+// only whole lines are handed to the port, between frames. A line that
+// does not fit is dropped whole.
+template <uint16_t Size>
+class DebugLog : public Print {
+public:
+  DebugLog() : _length(0), _lines(0), _sent(0), _dropping(false) {}
+
+  virtual size_t write(uint8_t c)
+  {
+    if (_dropping) {
+      _dropping = c != '\n';
+      return 1;
+    }
+    if (_length >= Size) {
+      _length = _lines;         // the line so far goes too
+      _dropping = c != '\n';
+      return 1;
+    }
+    _data[_length++] = c;
+    if (c == '\n') {
+      _lines = _length;
+    }
+    return 1;
+  }
+
+  using Print::write;
+
+  // Whole lines waiting to be sent.
+  bool pending() const { return _sent < _lines; }
+
+  // Writes what fits without blocking. Returns true once every whole line
+  // went; a line still being printed stays.
+  template <typename Port>
+  bool drain(Port &port)
+  {
+    uint16_t count = _lines - _sent;
+    int room = port.availableForWrite();
+    if (room <= 0) {
+      return !pending();
+    }
+    if (count > (uint16_t)room) {
+      count = room;
+    }
+    _sent += port.write(_data + _sent, count);
+    if (pending()) {
+      return false;
+    }
+    memmove(_data, _data + _lines, _length - _lines);
+    _length -= _lines;
+    _lines = 0;
+    _sent = 0;
+    return true;
+  }
+
+private:
+  uint8_t _data[Size];
+  uint16_t _length;
+  uint16_t _lines;      // end of the last whole line
+  uint16_t _sent;
+  bool _dropping;
+};
+
+#endif // _GGH_DEBUG_LOG_H_
@@ -0,0 +1,65 @@
+#include "door_motion.h"
+
+uint32_t motion::ease(profile shape, uint32_t t)
+{
+  if (t >= ONE) {
+    return ONE;
+  }
+  uint32_t t2 = t * t >> 15;
+  switch (shape) {
+    case profile::TRAPEZOID:
+      // accelerating 8/3 t^2 up to 1/6 at t = 1/4, cruising at 4/3 and
+      // the mirror image to stop
+      if (t < ONE / 4) {
+        return t2 * 8 / 3;
+      }
+      if (t > ONE - ONE / 4) {
+        uint32_t r = ONE - t;
+        return ONE - (r * r >> 15) * 8 / 3;
+      }
+      return (t - ONE / 8) * 4 / 3;
+
+    case profile::EASE_IN_OUT: {
+      // t^2 (3 - 2t) with t^2 kept whole, split so every product fits 32
+      // bits; truncating t^2 first would let the curve step backwards
+      uint32_t square = t * t;
+      uint32_t rest = 3 * ONE - 2 * t;
+      return ((square >> 15) * rest + ((square & (ONE - 1)) * rest >> 15)) >> 15;
+    }
+
+    case profile::LINEAR:
+    default:
+      return t;
+  }
+}
+
+int32_t motion::interpolate(int32_t from, int32_t to, uint32_t progress)
+{
+  return from + (((to - from) * (int32_t)(progress >> 1)) >> 14);
+}
+
+motion::Move::Move()
+{
+  _started = 0;
+  _duration = 0;
+  _shape = profile::LINEAR;
+  _active = false;
+}
+
+void motion::Move::start(uint32_t now, uint16_t duration_ms, profile shape)
+{
+  _started = now;
+  _duration = duration_ms;
+  _shape = shape;
+  _active = true;
+}
+
+uint32_t motion::Move::update(uint32_t now)
+{
+  uint32_t elapsed = now - _started;
+  if (!_active || elapsed >= _duration) {
+    _active = false;
+    return ONE;
+  }
+  return ease(_shape, elapsed * ONE / _duration);
+}
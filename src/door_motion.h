@@ -0,0 +1,46 @@
+#ifndef _GGH_DOOR_MOTION_H_
+#define _GGH_DOOR_MOTION_H_
+
+#include "stdint.h"
+#include "Arduino.h"
+
+namespace motion {
+
+  // Progress and positions along a move are fractions with ONE for the
+  // whole way, 15 bits so products with a 16 bit span fit an int32.
+  static const uint32_t ONE = 1UL << 15;
+
+  enum class profile : uint8_t {
+    LINEAR      = 0,
+    TRAPEZOID   = 1,    // accelerate for a quarter, cruise, brake for a quarter
+    EASE_IN_OUT = 2     // smoothstep, 3t^2 - 2t^3
+  };
+
+  // Shapes t, 0..ONE of the move's time, into 0..ONE of its distance.
+  uint32_t ease(profile shape, uint32_t t);
+
+  // from + (to - from) * progress, for spans of up to 16 bits.
+  int32_t interpolate(int32_t from, int32_t to, uint32_t progress);
+
+  // A timed move, advanced by calling update() from a tick. It only keeps
+  // time; what moves is up to the caller, see interpolate().
+  class Move {
+  public:
+    Move();
+
+    void start(uint32_t now, uint16_t duration_ms, profile shape);
+    void stop() { _active = false; }
+    bool active() const { return _active; }
+
+    // Eased progress at now, 0..ONE. Reaching ONE ends the move.
+    uint32_t update(uint32_t now);
+
+  private:
+    uint32_t _started;
+    uint16_t _duration;
+    profile _shape;
+    bool _active;
+  };
+};
+
+#endif // _GGH_DOOR_MOTION_H_
@@ -0,0 +1,44 @@
+#ifndef _GGH_FAST_PIN_H_
+#define _GGH_FAST_PIN_H_
+
+#include "stdint.h"
+#include "Arduino.h"
+
+namespace io {
+
+  // Digital output whose pin is known at compile time. On the ATmega328P
+  // (Uno and friends) the port and bit are resolved by the compiler and
+  // high()/low() compile to a single sbi/cbi, instead of the table lookups
+  // and interrupt guard digitalWrite() goes through on every call. Anywhere
+  // else it falls back to digitalWrite().
+  template <uint8_t Pin>
+  class OutputPin {
+  public:
+    static void begin()
+    {
+      pinMode(Pin, OUTPUT);
+      high();
+    }
+
+#if defined(__AVR_ATmega328P__)
+    static_assert(Pin < 20, "the ATmega328P has digital pins 0..19");
+
+    static void high() { port() |= MASK; }
+    static void low() { port() &= (uint8_t)~MASK; }
+
+  private:
+    // D0..D7 are PORTD, D8..D13 PORTB and A0..A5 (14..19) PORTC.
+    static const uint8_t MASK = 1 << (Pin < 8 ? Pin : Pin < 14 ? Pin - 8 : Pin - 14);
+
+    static volatile uint8_t &port()
+    {
+      return Pin < 8 ? PORTD : Pin < 14 ? PORTB : PORTC;
+    }
+#else
+    static void high() { digitalWrite(Pin, HIGH); }
+    static void low() { digitalWrite(Pin, LOW); }
+#endif
+  };
+};
+
+#endif // _GGH_FAST_PIN_H_
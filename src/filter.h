@@ -0,0 +1,140 @@
+#ifndef _GGH_FILTER_H_
+#define _GGH_FILTER_H_
+
+#include "stdint.h"
+#include "Arduino.h"
+
+namespace sensor {
+  namespace temperature {
+
+    enum class filter_mode : uint8_t {
+      NONE     = 0,
+      MEDIAN_3 = 1,   // median of the last 3 samples
+      MEDIAN_5 = 2,   // median of the last 5 samples
+      IIR      = 3    // first order low pass, y += alpha * (x - y)
+    };
+
+    // Smooths the readings of one channel between decode and publish.
+    // Oversampling first averages that many conversions into one sample,
+    // then the chosen filter runs on it. alpha is in 1/256ths and the IIR
+    // keeps 8 extra fraction bits of state. Every add() costs the same no
+    // matter what came before, and everything lives inside the object
+    // (20 bytes on AVR); nothing is allocated.
+    class Filter {
+    public:
+      static const uint8_t MAX_OVERSAMPLING = 8;
+
+      Filter() : _mode(filter_mode::NONE), _alpha(64), _oversampling(1) { reset(); }
+
+      void configure(filter_mode mode, uint8_t alpha, uint8_t oversampling)
+      {
+        _mode = mode;
+        _alpha = alpha ? alpha : 1;
+        _oversampling = oversampling < 1 ? 1 : oversampling > MAX_OVERSAMPLING ? MAX_OVERSAMPLING : oversampling;
+        reset();
+      }
+
+      filter_mode mode() const { return _mode; }
+      uint8_t alpha() const { return _alpha; }
+      uint8_t oversampling() const { return _oversampling; }
+
+      // Forgets the past; the next sample starts the filter over.
+      void reset()
+      {
+        _sum = 0;
+        _count = 0;
+        _head = 0;
+        _primed = false;
+      }
+
+      // Feeds one conversion. Returns true, with output set, once every
+      // oversampling conversions.
+      bool add(int16_t value, int16_t &output)
+      {
+        _sum += value;
+        if (++_count < _oversampling) {
+          return false;
+        }
+        int16_t sample = (int16_t)(_sum / _count);
+        _sum = 0;
+        _count = 0;
+
+        if (!_primed) {
+          for (uint8_t i = 0; i < 5; i++) {
+            _state.window[i] = sample;
+          }
+          if (_mode == filter_mode::IIR) {
+            _state.iir = (int32_t)sample << 8;
+          }
+          _primed = true;
+        }
+
+        switch (_mode) {
+          case filter_mode::MEDIAN_3:
+          case filter_mode::MEDIAN_5: {
+            uint8_t taps = _mode == filter_mode::MEDIAN_3 ? 3 : 5;
+            _state.window[_head] = sample;
+            _head = _head + 1 >= taps ? 0 : _head + 1;
+            output = taps == 3 ? median3(_state.window) : median5(_state.window);
+            break;
+          }
+          case filter_mode::IIR:
+            _state.iir += ((((int32_t)sample << 8) - _state.iir) * _alpha) >> 8;
+            output = (int16_t)((_state.iir + 128) >> 8);
+            break;
+          default:
+            output = sample;
+            break;
+        }
+        return true;
+      }
+
+    private:
+      filter_mode _mode;
+      uint8_t _alpha;
+      uint8_t _oversampling;
+      uint8_t _count;
+      uint8_t _head;
+      bool _primed;
+      int32_t _sum;
+      union {
+        int16_t window[5];
+        int32_t iir;
+      } _state;
+
+      static void order(int16_t &a, int16_t &b)
+      {
+        if (a > b) {
+          int16_t t = a;
+          a = b;
+          b = t;
+        }
+      }
+
+      static int16_t median3(const int16_t *w)
+      {
+        int16_t a = w[0], b = w[1], c = w[2];
+        order(a, b);
+        order(b, c);
+        order(a, b);
+        return b;
+      }
+
+      // Fixed compare network, the same 7 comparisons every time.
+      static int16_t median5(const int16_t *w)
+      {
+        int16_t a = w[0], b = w[1], c = w[2], d = w[3], e = w[4];
+        order(a, b);
+        order(d, e);
+        order(a, d);    // a is now the smallest of a, b, d, e
+        order(b, e);    // e the largest
+        order(b, c);
+        order(c, d);
+        order(b, c);    // c is the median of b, c, d
+        return c;
+      }
+    };
+  };
+};
+
+#endif // _GGH_FILTER_H_
@@ -0,0 +1,37 @@
+#include "fixed_point.h"
+
+size_t fixed::print(Print &out, int32_t value, uint8_t fraction_bits)
+{
+  uint32_t magnitude = value < 0 ? -(uint32_t)value : (uint32_t)value;
+
+  uint32_t whole = magnitude >> fraction_bits;
+  uint16_t thousandths = 0;
+  if (fraction_bits > 0) {
+    uint32_t fraction = magnitude & (((uint32_t)1 << fraction_bits) - 1);
+    uint32_t half = (uint32_t)1 << (fraction_bits - 1);
+    thousandths = (uint16_t)((fraction * 1000 + half) >> fraction_bits);
+    if (thousandths >= 1000) {
+      whole++;
+      thousandths -= 1000;
+    }
+  }
+
+  // built backwards: three decimals, the point, the whole part and the sign
+  char buffer[16];
+  char *p = &buffer[sizeof(buffer)];
+  for (uint8_t i = 0; i < 3; i++) {
+    uint16_t next = thousandths / 10;
+    *--p = '0' + (thousandths - next * 10);
+    thousandths = next;
+  }
+  *--p = '.';
+  do {
+    uint32_t next = whole / 10;
+    *--p = '0' + (uint8_t)(whole - next * 10);
+    whole = next;
+  } while (whole);
+  if (value < 0) {
+    *--p = '-';
+  }
+  return out.write((const uint8_t *)p, &buffer[sizeof(buffer)] - p);
+}
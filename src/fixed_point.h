@@ -0,0 +1,25 @@
+#ifndef _GGH_FIXED_POINT_H_
+#define _GGH_FIXED_POINT_H_
+
+#include "stdint.h"
+#include "Arduino.h"
+
+// Temperatures are kept as binary fixed point integers, the way the MAX31855
+// reports them: thermocouple values in 0.25 C steps (2 fraction bits) and
+// junction values in 0.0625 C steps (4 fraction bits).
+namespace fixed {
+
+  static const uint8_t QUARTER_DEGREES = 2;
+  static const uint8_t SIXTEENTH_DEGREES = 4;
+
+  // Prints value / 2^fraction_bits with three decimals, rounded half away
+  // from zero, using integer arithmetic only. fraction_bits must be <= 16.
+  size_t print(Print &out, int32_t value, uint8_t fraction_bits);
+
+  inline double to_double(int32_t value, uint8_t fraction_bits)
+  {
+    return (double)value / (double)(1L << fraction_bits);
+  }
+};
+
+#endif // _GGH_FIXED_POINT_H_
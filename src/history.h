@@ -0,0 +1,138 @@
+#ifndef _GGH_HISTORY_H_
+#define _GGH_HISTORY_H_
+
+#include "stdint.h"
+#include "Arduino.h"
+#include "fixed_point.h"
+
+namespace sensor {
+  namespace temperature {
+
+    // Last Capacity readings of one channel with their millis() timestamps,
+    // plus running statistics over everything added since the last reset.
+    // Values are fixed point with FractionBits fraction bits. All storage is
+    // inside the object, so the RAM cost is fixed at compile time:
+    // Capacity * 6 + 16 bytes.
+    template <uint8_t Capacity, uint8_t FractionBits>
+    class History {
+    public:
+      struct sample {
+        uint32_t time;
+        int16_t value;
+      };
+
+      History() { reset(); }
+
+      void reset()
+      {
+        _head = 0;
+        _size = 0;
+        _count = 0;
+        _sum = 0;
+      }
+
+      void add(uint32_t time, int16_t value)
+      {
+        _samples[_head].time = time;
+        _samples[_head].value = value;
+        _head = _head + 1 == Capacity ? 0 : _head + 1;
+        if (_size < Capacity) {
+          _size++;
+        }
+
+        if (_count == 0) {
+          _min = _max = value;
+          _ema = (int32_t)value << EMA_EXTRA_BITS;
+        }
+        else {
+          if (value < _min) {
+            _min = value;
+          }
+          if (value > _max) {
+            _max = value;
+          }
+          _ema += (((int32_t)value << EMA_EXTRA_BITS) - _ema) >> EMA_SHIFT;
+        }
+
+        // Keep the mean bounded: past MEAN_WINDOW samples halve the weight
+        // of everything before, so the sum cannot overflow.
+        if (_count == MEAN_WINDOW) {
+          _sum /= 2;
+          _count /= 2;
+        }
+        _sum += value;
+        _count++;
+      }
+
+      uint8_t size() const { return _size; }
+
+      // i = 0 is the oldest sample still held.
+      const sample &at(uint8_t i) const
+      {
+        uint8_t index = _head + (Capacity - _size) + i;
+        return _samples[index >= Capacity ? index - Capacity : index];
+      }
+
+      size_t printStats(Print &out, uint8_t channel) const
+      {
+        size_t n = 0;
+        n += out.print(F("{ \"history\": {\"channel\": "));
+        n += out.print(channel, DEC);
+        n += out.print(F(",\"count\": "));
+        n += out.print(_count, DEC);
+        if (_count > 0) {
+          n += out.print(F(",\"min\": "));
+          n += fixed::print(out, _min, FractionBits);
+          n += out.print(F(",\"max\": "));
+          n += fixed::print(out, _max, FractionBits);
+          n += out.print(F(",\"mean\": "));
+          n += fixed::print(out, (_sum << MEAN_EXTRA_BITS) / (int32_t)_count, FractionBits + MEAN_EXTRA_BITS);
+          n += out.print(F(",\"ema\": "));
+          n += fixed::print(out, _ema, FractionBits + EMA_EXTRA_BITS);
+        }
+        n += out.println(F("}}"));
+        return n;
+      }
+
+      size_t printWindow(Print &out, uint8_t channel, uint32_t now) const
+      {
+        size_t n = 0;
+        n += out.print(F("{ \"history\": {\"channel\": "));
+        n += out.print(channel, DEC);
+        n += out.print(F(",\"now\": "));
+        n += out.print(now, DEC);
+        n += out.print(F(",\"samples\": ["));
+        for (uint8_t i = 0; i < _size; i++) {
+          const sample &s = at(i);
+          if (i > 0) {
+            n += out.print(',');
+          }
+          n += out.print('[');
+          n += out.print(s.time, DEC);
+          n += out.print(',');
+          n += fixed::print(out, s.value, FractionBits);
+          n += out.print(']');
+        }
+        n += out.println(F("]}}"));
+        return n;
+      }
+
+    private:
+      static const uint16_t MEAN_WINDOW = 4096;
+      static const uint8_t MEAN_EXTRA_BITS = 4;
+      static const uint8_t EMA_SHIFT = 3;       // alpha = 1/8
+      static const uint8_t EMA_EXTRA_BITS = 4;
+
+      sample _samples[Capacity];
+      uint8_t _head;
+      uint8_t _size;
+      uint16_t _count;
+      int16_t _min;
+      int16_t _max;
+      int32_t _sum;
+      int32_t _ema;
+    };
+  };
+};
+
+#endif // _GGH_HISTORY_H_
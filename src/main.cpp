@@ -1,5 +1,21 @@
 
 #include "max31855.h"
+#include "binary_frame.h"
+#include "scheduler.h"
+#include "history.h"
+#include "spsc_queue.h"
+#include "sample_timer.h"
+#include "sample_planner.h"
+#include "command_parser.h"
+#include "config_store.h"
+#include "sensor_bank.h"
+#include "output_buffer.h"
+#include "debug_log.h"
+#include "buffer_print.h"
+#include "profile.h"
+#include "pid.h"
+#include "door_motion.h"
+#include "alarm.h"
 #include "SPI.h"
 #include "EEPROM.h"
 #include "Servo.h"
@@ -7,411 +23,1853 @@
 #include "util/delay.h"
 
 #define FIRMWARE_VERSION "1.0"
+#define SERIAL_BAUD 115200
+
+#define DOOR_PWM_PIN 11
+
+using tc = sensor::temperature::thermocouple::max31855::Driver;
+using slot = sensor::temperature::thermocouple::max31855::slot;
+
+// Boards, by the chip selects of their channels in channel order. The
+// second quad board adds channels 4..7.
+using quad_board = sensor::temperature::thermocouple::max31855::Bank<10, 9, 8, 7>;
+using dual_quad_board = sensor::temperature::thermocouple::max31855::Bank<10, 9, 8, 7, 6, 5, 4, 3>;
 
 // Enable this if you have both boards utilizing all 8 channels.
 //#define HAS_8_CHANNELS
 
-#define DOOR_PWM_PIN 11
-#define DOOR_MOVEMENT_STEPS 100.0
+#ifndef HAS_8_CHANNELS
+using sensor_bank = quad_board;
+#else
+using sensor_bank = dual_quad_board;
+#endif
 
-using tc = sensor::temperature::thermocouple::max31855::Driver;
+#if defined(HAS_8_CHANNELS) && defined(__AVR_ATmega328P__)
+#error "8 channels need more RAM than an uno has, build the mega_8ch env"
+#endif
+
+#define NUMBER_OF_SENSORS (sensor_bank::SIZE)
+
+// Channel sets are passed around as one bit per channel.
+static_assert(NUMBER_OF_SENSORS <= 8, "channel masks are 8 bits wide");
 
-#define CHIP_SELECT_CHANNEL_0 10
-#define CHIP_SELECT_CHANNEL_1  9
-#define CHIP_SELECT_CHANNEL_2  8
-#define CHIP_SELECT_CHANNEL_3  7
-#define CHIP_SELECT_CHANNEL_4  6
-#define CHIP_SELECT_CHANNEL_5  5
-#define CHIP_SELECT_CHANNEL_6  4
-#define CHIP_SELECT_CHANNEL_7  3
+// RAM set aside for the per channel sample history (H command), split
+// evenly across the channels: 8 readings each with 4 channels. An uno has
+// 2 KB in all, and the stack needs what is left.
+#define HISTORY_RAM_BUDGET 192
+#define HISTORY_CAPACITY (HISTORY_RAM_BUDGET / (NUMBER_OF_SENSORS * 6))
+
+using channel_history = sensor::temperature::History<HISTORY_CAPACITY, fixed::QUARTER_DEGREES>;
 
 typedef struct __sensors {
     tc tc;
     bool enabled;
+    channel_history history;
+    // change-only streaming: what was last sent and how far the value may
+    // move, in 0.25 C counts, before it is sent again.
+    uint8_t deadband;
+    int16_t reported_value;
+    sensor::temperature::thermocouple::status reported_status;
+    // what the last read of the channel's chip select found, see discovery
+    slot found;
+    safety::Alarm alarm;
 } temperature_sensor;
 
-temperature_sensor sensors[] = {
-  { tc(0, CHIP_SELECT_CHANNEL_0), true },
-  { tc(1, CHIP_SELECT_CHANNEL_1), true },
-  { tc(2, CHIP_SELECT_CHANNEL_2), true },
-  { tc(3, CHIP_SELECT_CHANNEL_3), true }
-
-#ifdef HAS_8_CHANNELS
-,
-  { tc(4, CHIP_SELECT_CHANNEL_4), true },
-  { tc(5, CHIP_SELECT_CHANNEL_5), true },
-  { tc(6, CHIP_SELECT_CHANNEL_6), true },
-  { tc(7, CHIP_SELECT_CHANNEL_7), true }
-#endif
-};
+sensor_bank gSensorBank;
+temperature_sensor sensors[NUMBER_OF_SENSORS];
 
 Servo door;
 
 bool gStreamingTemperatureEnabled = false;
 bool gStreamingStatusEnabled = false;
+bool gStreamingBinary = false;
 bool gDoorOpened = false;
 uint16_t gDoorClosedPosition = 0;
 uint16_t gDoorOpenPosition = 0;
 uint16_t gStreamingDelay = 0;
+bool gStreamingChangesOnly = false;
+uint16_t gKeepAliveDelay = 0;
+bool gDiscoveryEnabled = true;
 
-#define MAX_CMD_BUF_SIZE 16
-char gCommandBuffer[MAX_CMD_BUF_SIZE];
-uint8_t gCommandBufferIndex = 0;
+// Door motion: D O and D S start a move that gDoorTask advances every
+// DOOR_TICK_MS, the servo's frame, so sampling and streaming carry on while
+// the door moves. The door's place is kept as a fraction of its travel,
+// 0 closed to motion::ONE open, and written to the servo in microseconds.
+#define DOOR_TICK_MS 20
 
-#ifndef HAS_8_CHANNELS
-  #define NUMBER_OF_SENSORS 4
-#else
-  #define NUMBER_OF_SENSORS 8
-#endif
+// Door states, as reported in status frames.
+#define DOOR_CLOSED 0
+#define DOOR_OPEN 1
+#define DOOR_CLOSING 2
+#define DOOR_OPENING 3
+#define DOOR_CONTROLLED 4
+
+motion::Move gDoorMove;
+uint32_t gDoorTravel = 0;
+uint32_t gDoorMoveFrom = 0;
+uint32_t gDoorMoveTo = 0;
 
-#define EEPROM_SENSOR_ENABLED_OFFSET 4
-#define EEPROM_STREAM_TEMPERATURE_OFFSET (EEPROM_SENSOR_ENABLED_OFFSET + NUMBER_OF_SENSORS)
-#define EEPROM_STREAM_STATUS_OFFSET (EEPROM_STREAM_TEMPERATURE_OFFSET + 1)
-#define EEPROM_STREAMING_DELAY_OFFSET (EEPROM_STREAM_STATUS_OFFSET + 1)
-#define EEPROM_DOOR_CLOSED_OFFSET (EEPROM_STREAMING_DELAY_OFFSET + 2)
-#define EEPROM_DOOR_OPEN_OFFSET (EEPROM_DOOR_CLOSED_OFFSET + 2)
-#define EEPROM_DOOR_IS_OPEN_OFFSET (EEPROM_DOOR_OPEN_OFFSET + 2)
+// On-device temperature control: a PID on the average of the chosen
+// channels drives the door every CONTROL_PERIOD_MS, the chips' conversion
+// time, so a correction is at most one sample late. See pid.h for units.
+#define CONTROL_PERIOD_MS 100
+
+control::Pid gPid;
+bool gControlEnabled = false;
+uint8_t gControlChannels = 1;       // bit per channel
+int16_t gControlSetpoint = 0;       // 0.25 C counts
+uint32_t gControlGains[3] = { 0, 0, 0 };
+int16_t gControlInput = 0;          // average of the OK control channels
+bool gControlInputValid = false;
+
+// Values of the two stream flags in the config.
+#define STREAM_OFF 0
+#define STREAM_JSON 1
+#define STREAM_BINARY 2
 
 #define DEFAULT_DOOR_OPEN_POSITION 360
 #define DEFAULT_STREAMING_DELAY 500
+// One count is the chip's resolution, so by default only flicker of the last
+// bit is suppressed.
+#define DEFAULT_DEADBAND 1
+#define DEFAULT_KEEPALIVE_DELAY 10000
+#define MIN_KEEPALIVE_DELAY 100
+#define DEFAULT_FILTER_ALPHA 64     // 1/4 per sample
+#define DEFAULT_ALARM_HIGH 4800     // 1200 C
+#define DEFAULT_ALARM_HYSTERESIS 8  // 2 C
 
+// Everything kept across resets. Bump CONFIG_VERSION whenever the layout
+// changes; a stored config of another version is ignored and the defaults
+// are used. See config_store.h for how it is kept in EEPROM.
+#define CONFIG_VERSION 6
+#define CONFIG_SLOTS 6
 
-void validate_eeprom() {
-    // check if eeprom is initialized.
-  if (EEPROM.read(0) == 0xb
-    && EEPROM.read(1) == 0xe
-    && EEPROM.read(2) == 0xe
-    && EEPROM.read(3) == 0xf) {
-        #ifdef DEBUG_FIRMWARE
-            Serial.println("# EEPROM initialized. Reading saved values.");
-        #endif
-        // read in stored state
-        for (uint8_t i = 0; i < NUMBER_OF_SENSORS; i++) {
-            sensors[i].enabled = EEPROM.read(EEPROM_SENSOR_ENABLED_OFFSET + i) == 1;
-        }
-        gStreamingTemperatureEnabled = EEPROM.read(EEPROM_STREAM_TEMPERATURE_OFFSET) == 1;
-        gStreamingStatusEnabled = EEPROM.read(EEPROM_STREAM_STATUS_OFFSET) == 1;
+typedef struct __attribute__((packed)) __config {
+    uint8_t sensors_enabled;        // bit per channel
+    uint8_t stream_temperature;     // STREAM_OFF, STREAM_JSON or STREAM_BINARY
+    uint8_t stream_status;
+    uint16_t streaming_delay;
+    uint16_t door_closed_position;
+    uint16_t door_open_position;
+    uint8_t door_opened;
+    uint8_t stream_changes_only;
+    uint16_t keepalive_delay;
+    uint8_t deadband[NUMBER_OF_SENSORS];
+    uint8_t discovery;
+    uint8_t control_enabled;
+    uint8_t control_channels;       // bit per channel
+    int16_t control_setpoint;
+    uint32_t control_gains[3];      // kp, ki, kd
+    uint8_t filter_mode[NUMBER_OF_SENSORS];
+    uint8_t filter_alpha[NUMBER_OF_SENSORS];
+    uint8_t oversampling[NUMBER_OF_SENSORS];
+    int16_t alarm_high[NUMBER_OF_SENSORS];
+    int16_t alarm_low[NUMBER_OF_SENSORS];
+    uint8_t alarm_rise[NUMBER_OF_SENSORS];
+    uint8_t alarm_hysteresis[NUMBER_OF_SENSORS];
+    uint8_t alarm_masks[NUMBER_OF_SENSORS];   // armed in the low nibble, trips in the high
+    uint16_t sample_period[NUMBER_OF_SENSORS];
+} config;
 
-        gDoorClosedPosition = (EEPROM.read(EEPROM_DOOR_CLOSED_OFFSET + 1) << 8) | EEPROM.read(EEPROM_DOOR_CLOSED_OFFSET);
-        gDoorOpenPosition = (EEPROM.read(EEPROM_DOOR_OPEN_OFFSET + 1) << 8) | EEPROM.read(EEPROM_DOOR_OPEN_OFFSET);
-        gStreamingDelay = (EEPROM.read(EEPROM_STREAMING_DELAY_OFFSET + 1) << 8) | EEPROM.read(EEPROM_STREAMING_DELAY_OFFSET);
+// ConfigStore keeps slot lengths and offsets in a uint8_t.
+static_assert(sizeof(config) + storage::ConfigStore::SLOT_OVERHEAD <= UINT8_MAX,
+              "a config slot must fit a uint8_t length");
+static_assert(CONFIG_SLOTS * (sizeof(config) + storage::ConfigStore::SLOT_OVERHEAD) <= E2END + 1,
+              "config slots must fit the EEPROM");
 
-        gDoorOpened = EEPROM.read(EEPROM_DOOR_IS_OPEN_OFFSET) == 1;
+// When each channel is next read, see sample_planner.h. Here rather than
+// with the sampler so the config can use it.
+sampling::Planner<NUMBER_OF_SENSORS> gPlanner;
 
+config gConfig;
+storage::ConfigStore gConfigStore(&gConfig, sizeof(gConfig), CONFIG_VERSION, 0, CONFIG_SLOTS);
+
+uint8_t streamFlag(bool enabled) {
+    if (!enabled) {
+        return STREAM_OFF;
+    }
+    return gStreamingBinary ? STREAM_BINARY : STREAM_JSON;
+}
+
+// Copies the current settings into the config. The store writes it out once
+// the settings have been left alone for a moment, so a burst of commands
+// costs one commit and none of them wait for the EEPROM.
+void saveConfig() {
+    gConfig.sensors_enabled = 0;
+    for (uint8_t i = 0; i < NUMBER_OF_SENSORS; i++) {
+        if (sensors[i].enabled) {
+            gConfig.sensors_enabled |= 1 << i;
+        }
+        gConfig.deadband[i] = sensors[i].deadband;
+        const sensor::temperature::Filter &f = sensors[i].tc.filter();
+        gConfig.filter_mode[i] = (uint8_t)f.mode();
+        gConfig.filter_alpha[i] = f.alpha();
+        gConfig.oversampling[i] = f.oversampling();
+        const safety::Alarm &a = sensors[i].alarm;
+        gConfig.alarm_high[i] = a.high();
+        gConfig.alarm_low[i] = a.low();
+        gConfig.alarm_rise[i] = a.rise();
+        gConfig.alarm_hysteresis[i] = a.hysteresis();
+        gConfig.alarm_masks[i] = a.armed() | a.trips() << 4;
+        gConfig.sample_period[i] = gPlanner.period(i);
+    }
+    gConfig.stream_temperature = streamFlag(gStreamingTemperatureEnabled);
+    gConfig.stream_status = streamFlag(gStreamingStatusEnabled);
+    gConfig.streaming_delay = gStreamingDelay;
+    gConfig.door_closed_position = gDoorClosedPosition;
+    gConfig.door_open_position = gDoorOpenPosition;
+    gConfig.door_opened = gDoorOpened ? 1 : 0;
+    gConfig.stream_changes_only = gStreamingChangesOnly ? 1 : 0;
+    gConfig.keepalive_delay = gKeepAliveDelay;
+    gConfig.discovery = gDiscoveryEnabled ? 1 : 0;
+    gConfig.control_enabled = gControlEnabled ? 1 : 0;
+    gConfig.control_channels = gControlChannels;
+    gConfig.control_setpoint = gControlSetpoint;
+    for (uint8_t i = 0; i < 3; i++) {
+        gConfig.control_gains[i] = gControlGains[i];
+    }
+    gConfigStore.markDirty();
+}
+
+void loadConfig() {
+    if (gConfigStore.load()) {
         #ifdef DEBUG_FIRMWARE
-            Serial.println("# Saved Values");
-            for (uint8_t i = 0; i < NUMBER_OF_SENSORS; i++) {
-                Serial.print("# Sensor ");
-                Serial.print(i, DEC);
-                sensors[i].enabled ? Serial.println(" enabled.") : Serial.println(" disabled.");
-            }
-            Serial.print("# Temperature Streaming: ");
-            gStreamingTemperatureEnabled ? Serial.println("enabled.") : Serial.println("disabled.");
-            Serial.print("# Status Streaming: ");
-            gStreamingStatusEnabled ? Serial.println("enabled.") : Serial.println("disabled.");
-            Serial.print("# Streaming Delay: ");
-            Serial.println(gStreamingDelay, DEC);
-            Serial.print("# Door Closed Position: ");
-            Serial.println(gDoorClosedPosition, DEC);
-            Serial.print("# Door Open Position: ");
-            Serial.println(gDoorOpenPosition, DEC);
-            Serial.print("# Door State: ");
-            gDoorOpened ? Serial.println("opened.") : Serial.println("closed.");
+            Serial.print(F("# Config loaded from slot "));
+            Serial.println(gConfigStore.slot(), DEC);
         #endif
     }
     else {
         #ifdef DEBUG_FIRMWARE
-            Serial.println("# EEPROM not initialized. Setting default values.");
+            Serial.println(F("# No saved config. Setting default values."));
         #endif
+        gConfig.sensors_enabled = (1 << NUMBER_OF_SENSORS) - 1;
+        gConfig.stream_temperature = STREAM_OFF;
+        gConfig.stream_status = STREAM_OFF;
+        gConfig.streaming_delay = DEFAULT_STREAMING_DELAY;
+        gConfig.door_closed_position = 0;
+        gConfig.door_open_position = DEFAULT_DOOR_OPEN_POSITION;
+        gConfig.door_opened = 0;
+        gConfig.stream_changes_only = 0;
+        gConfig.keepalive_delay = DEFAULT_KEEPALIVE_DELAY;
+        for (uint8_t i = 0; i < NUMBER_OF_SENSORS; i++) {
+            gConfig.deadband[i] = DEFAULT_DEADBAND;
+            gConfig.filter_mode[i] = (uint8_t)sensor::temperature::filter_mode::NONE;
+            gConfig.filter_alpha[i] = DEFAULT_FILTER_ALPHA;
+            gConfig.oversampling[i] = 1;
+            gConfig.alarm_high[i] = DEFAULT_ALARM_HIGH;
+            gConfig.alarm_low[i] = 0;
+            gConfig.alarm_rise[i] = 0;
+            gConfig.alarm_hysteresis[i] = DEFAULT_ALARM_HYSTERESIS;
+            gConfig.alarm_masks[i] = 0;
+            gConfig.sample_period[i] = gPlanner.MIN_PERIOD_MS;
+        }
+        gConfig.discovery = 1;
+        gConfig.control_enabled = 0;
+        gConfig.control_channels = 1;
+        gConfig.control_setpoint = 0;
+        for (uint8_t i = 0; i < 3; i++) {
+            gConfig.control_gains[i] = 0;
+        }
+        gConfigStore.markDirty();
+    }
 
-        // initialize with default state
-        EEPROM.write(0, 0xb);
-        EEPROM.write(1, 0xe);
-        EEPROM.write(2, 0xe);
-        EEPROM.write(3, 0xf);
+    for (uint8_t i = 0; i < NUMBER_OF_SENSORS; i++) {
+        sensors[i].enabled = gConfig.sensors_enabled & (1 << i);
+        sensors[i].deadband = gConfig.deadband[i];
+        sensors[i].tc.filter().configure((sensor::temperature::filter_mode)gConfig.filter_mode[i],
+                                         gConfig.filter_alpha[i], gConfig.oversampling[i]);
+        sensors[i].alarm.configure(gConfig.alarm_high[i], gConfig.alarm_low[i],
+                                   gConfig.alarm_rise[i], gConfig.alarm_hysteresis[i]);
+        sensors[i].alarm.arm(gConfig.alarm_masks[i] & 0x0f, gConfig.alarm_masks[i] >> 4);
+        gPlanner.setPeriod(i, gConfig.sample_period[i]);
+    }
+    gStreamingTemperatureEnabled = gConfig.stream_temperature != STREAM_OFF;
+    gStreamingStatusEnabled = gConfig.stream_status != STREAM_OFF;
+    gStreamingBinary = gConfig.stream_temperature == STREAM_BINARY || gConfig.stream_status == STREAM_BINARY;
+    gStreamingDelay = gConfig.streaming_delay;
+    gDoorClosedPosition = gConfig.door_closed_position;
+    gDoorOpenPosition = gConfig.door_open_position;
+    gDoorOpened = gConfig.door_opened == 1;
+    gStreamingChangesOnly = gConfig.stream_changes_only == 1;
+    gKeepAliveDelay = gConfig.keepalive_delay;
+    gDiscoveryEnabled = gConfig.discovery == 1;
+    gControlEnabled = gConfig.control_enabled == 1;
+    gControlChannels = gConfig.control_channels;
+    gControlSetpoint = gConfig.control_setpoint;
+    for (uint8_t i = 0; i < 3; i++) {
+        gControlGains[i] = gConfig.control_gains[i];
+    }
 
-        // enable all channels
+    #ifdef DEBUG_FIRMWARE
+        Serial.println(F("# Saved Values"));
         for (uint8_t i = 0; i < NUMBER_OF_SENSORS; i++) {
-            EEPROM.write(EEPROM_SENSOR_ENABLED_OFFSET + i, 1);
+            Serial.print(F("# Sensor "));
+            Serial.print(i, DEC);
+            sensors[i].enabled ? Serial.println(F(" enabled.")) : Serial.println(F(" disabled."));
         }
+        Serial.print(F("# Temperature Streaming: "));
+        gStreamingTemperatureEnabled ? Serial.println(F("enabled.")) : Serial.println(F("disabled."));
+        Serial.print(F("# Status Streaming: "));
+        gStreamingStatusEnabled ? Serial.println(F("enabled.")) : Serial.println(F("disabled."));
+        Serial.print(F("# Streaming Format: "));
+        gStreamingBinary ? Serial.println(F("binary.")) : Serial.println(F("json."));
+        Serial.print(F("# Streaming Delay: "));
+        Serial.println(gStreamingDelay, DEC);
+        Serial.print(F("# Door Closed Position: "));
+        Serial.println(gDoorClosedPosition, DEC);
+        Serial.print(F("# Door Open Position: "));
+        Serial.println(gDoorOpenPosition, DEC);
+        Serial.print(F("# Door State: "));
+        gDoorOpened ? Serial.println(F("opened.")) : Serial.println(F("closed."));
+        Serial.print(F("# Changes Only: "));
+        gStreamingChangesOnly ? Serial.println(F("enabled.")) : Serial.println(F("disabled."));
+        Serial.print(F("# Keep Alive Delay: "));
+        Serial.println(gKeepAliveDelay, DEC);
+        Serial.print(F("# Channel Discovery: "));
+        gDiscoveryEnabled ? Serial.println(F("enabled.")) : Serial.println(F("disabled."));
+        Serial.print(F("# Temperature Control: "));
+        gControlEnabled ? Serial.println(F("enabled.")) : Serial.println(F("disabled."));
+        Serial.print(F("# Control Setpoint: "));
+        Serial.println(gControlSetpoint, DEC);
+    #endif
+}
+
+void serviceCommands();
+void sampleSensors();
+void emitFrame();
+void serviceTx();
+void updateSweepChannels();
+void runControl();
+void moveDoor();
+
+// Chips are read from the Timer2 interrupt, SWEEP_PERIOD_TICKS ms apart, so
+// sample timing does not depend on what loop() is doing. Once a conversion
+// is ready the channels gPlanner finds due are read in one burst, and the
+// raw frames are queued for loop() to decode; disabled channels are dropped
+// there. A tick with no channel due reads nothing and those chips keep
+// converting.
+#define SWEEP_PERIOD_TICKS 10
+
+// Channel discovery: only the chips in gSweepChannels, the channels that
+// are enabled and, with discovery on, were found live, are planned. Every
+// PROBE_INTERVAL_MS, and on the first sweep, every chip select is read
+// instead, so a thermocouple plugged back in is picked up again; the chips
+// that were not due are only classified.
+#define PROBE_INTERVAL_MS 5000
 
-        EEPROM.write(EEPROM_STREAM_TEMPERATURE_OFFSET, 0); // disable temperature streaming by default
-        EEPROM.write(EEPROM_STREAM_STATUS_OFFSET, 0); // disable status streaming by default
-        EEPROM.write(EEPROM_DOOR_CLOSED_OFFSET, 0);
-        EEPROM.write(EEPROM_DOOR_CLOSED_OFFSET + 1, 0);
-        EEPROM.write(EEPROM_DOOR_OPEN_OFFSET, ((uint16_t)DEFAULT_DOOR_OPEN_POSITION));
-        EEPROM.write(EEPROM_DOOR_OPEN_OFFSET + 1, ((uint16_t)DEFAULT_DOOR_OPEN_POSITION) >> 8);
-        EEPROM.write(EEPROM_STREAMING_DELAY_OFFSET, ((uint16_t)DEFAULT_STREAMING_DELAY));
-        EEPROM.write(EEPROM_STREAMING_DELAY_OFFSET + 1, ((uint16_t)DEFAULT_STREAMING_DELAY) >> 8);
-        EEPROM.write(EEPROM_DOOR_IS_OPEN_OFFSET, 0);
+volatile uint8_t gSweepChannels = sensor_bank::ALL;
+
+typedef struct __raw_sweep {
+    uint32_t time;      // millis()
+    uint8_t channels;   // the frames that were read
+    uint8_t due;        // and those to decode
+    uint32_t frames[NUMBER_OF_SENSORS];
+} raw_sweep;
+
+SpscQueue<raw_sweep, 4> gSampleQueue;
+// Channels that have published a reading since boot.
+uint8_t gReadChannels = 0;
+
+void sampleTick() {
+    static uint8_t ticks = 0;
+    if (++ticks < SWEEP_PERIOD_TICKS) {
+        return;
     }
+    ticks = 0;
+
+    uint32_t now = micros();
+    if (!gSensorBank.due(now)) {
+        return;
+    }
+
+    static bool probed = false;
+    static uint32_t lastProbe = 0;
+    raw_sweep sweep;
+    sweep.time = millis();
+    sweep.due = gPlanner.due(sweep.time, gSweepChannels);
+    sweep.channels = sweep.due;
+    if (!probed || sweep.time - lastProbe >= PROBE_INTERVAL_MS) {
+        probed = true;
+        lastProbe = sweep.time;
+        sweep.channels = sensor_bank::ALL;
+    }
+    if (!sweep.channels) {
+        return;
+    }
+    PROFILE_SCOPE(SWEEP);
+    gSensorBank.sweep(now, sweep.frames, sweep.channels);
+    gSampleQueue.push(sweep);
+}
+
+// loop() only polls these. Commands are read on every pass, queued samples
+// are decoded into the history as they arrive, the emitter starts a frame
+// on the streaming period and the TX task feeds it to the port while one
+// is going out.
+scheduler::Task gCommandTask(serviceCommands);
+scheduler::Task gSampleTask(sampleSensors);
+scheduler::Task gEmitTask(emitFrame, true);
+scheduler::Task gTxTask(serviceTx);
+scheduler::Task gControlTask(runControl);
+scheduler::Task gDoorTask(moveDoor);
+
+// In change-only mode a frame carries just the channels that moved past
+// their deadband or changed status, and the door when it moved. Every
+// gKeepAliveDelay ms, and on the first frame, everything is sent.
+uint32_t gLastFullFrame = 0;
+bool gFullFrameDue = true;
+// Channels with a reading newer than the last one streamed. Frames carry
+// only these, so a channel sampled less often than the stream period is
+// sent once per reading, and a frame with nothing new is not sent.
+uint8_t gFreshChannels = 0;
+uint8_t gReportedDoorState = DOOR_CLOSED;
+uint16_t gReportedDoorPosition = 0;
+
+// Streamed frames never wait for the UART. A frame is rendered a piece at a
+// time (the JSON header, one channel record, the door trailer, or one binary
+// frame) into gTxBuffer, and serviceTx() only hands the port what fits in
+// its TX buffer. Records are rendered as late as possible, so they carry the
+// newest reading. A period that comes round while a frame is still going
+// out is coalesced into one pending frame, started as soon as the link is
+// free; any further period before then is dropped. With a delay of 0 the
+// link sets the pace, so there are no periods to coalesce or drop.
+#define FRAME_HEADER 0
+#define FRAME_RECORDS 1
+#define FRAME_TRAILER 2
+#define FRAME_CONTROL 3
+#define FRAME_DONE 4
+
+typedef struct __stream_frame {
+    uint8_t part;       // FRAME_HEADER to FRAME_DONE
+    uint8_t channels;   // records still to render
+    bool first;         // no record rendered yet
+    bool door;
+    bool binary;
+    uint32_t sequence;
+} stream_frame;
+
+// Largest piece: a JSON record and its comma, or an encoded binary frame.
+#define TX_STAGING_SIZE (tc::JSON_MAX_LENGTH + 2)
+static_assert(1 + protocol::binary::Frame::MAX_PAYLOAD + 2 + 2 <= TX_STAGING_SIZE,
+              "a binary frame must fit the staging buffer");
+
+OutputBuffer<TX_STAGING_SIZE> gTxBuffer;
+#ifdef DEBUG_FIRMWARE
+// Debug lines from the sampling path, sent by serviceTx() between frames.
+DebugLog<128> gDebugLog;
+#endif
+stream_frame gFrame = {};  // FRAME_DONE from setup()
+bool gFramePending = false;
+uint32_t gFramesCoalesced = 0;
+uint32_t gFramesDropped = 0;
+// Numbers the streamed frames; see binary_frame.h.
+uint32_t gFrameSequence = 0;
+
+bool renderPiece(Print &out, stream_frame &frame, bool report);
+void startFrame();
+
+// Between pieces here a line of its own (an alarm event, a debug line, a
+// command reply) can go out without splitting the frame: anywhere in a
+// binary stream, and before or after a JSON frame.
+bool atLineBoundary() {
+    return gFrame.binary || gFrame.part == FRAME_HEADER || gFrame.part == FRAME_DONE;
+}
+
+// Brings a JSON frame caught among its records to a line boundary in two
+// short pieces, "]" and "}": the channels and door it did not reach follow
+// in a frame straight after.
+void cutFrame() {
+    if (gFrame.part == FRAME_RECORDS) {
+        gFrame.channels = 0;
+        gFrame.door = false;
+        gFramePending = true;
+    }
+}
+
+// Alarm events (see alarm.h) do not wait for the stream. sampleSensors()
+// queues one for every condition raised or cleared, and serviceTx() sends
+// it at the next piece boundary, ahead of the rest of any frame going out.
+// A binary frame is always whole there. A JSON frame is one line, so one
+// caught among its records is cut short (see cutFrame()). An event so waits
+// for at most one piece, about 13 ms at 115200 baud, whatever the streaming
+// period, and is sent with streaming off too, in the last stream format.
+typedef struct __alarm_event {
+    uint32_t time;      // millis() of the reading
+    int16_t value;      // 0.25 C counts
+    uint8_t channel;
+    uint8_t condition;  // one of the safety:: bits
+    bool active;        // raised, or cleared
+    int8_t status;      // thermocouple status code
+} alarm_event;
+
+// Only loop() touches it, so the SPSC ring is used for its fixed storage.
+SpscQueue<alarm_event, 8> gAlarmEvents;
+
+// Call after any change to the streaming flags or delay. A frame already
+// going out is finished in its own format.
+void restartStreaming() {
+    gFullFrameDue = true;
+    gFramePending = false;
+    if (gStreamingStatusEnabled || gStreamingTemperatureEnabled) {
+        gEmitTask.start(gStreamingDelay);
+    }
+    else {
+        gEmitTask.stop();
+    }
+}
+
+// Servo pulse for a D C position: below MIN_PULSE_WIDTH it is an angle,
+// as Servo::write() takes it, otherwise already microseconds.
+uint16_t servoPulse(uint16_t position) {
+    if (position >= MIN_PULSE_WIDTH) {
+        return position;
+    }
+    if (position > 180) {
+        position = 180;
+    }
+    return MIN_PULSE_WIDTH + (uint32_t)position * (MAX_PULSE_WIDTH - MIN_PULSE_WIDTH) / 180;
+}
+
+// Where the door is now, in D C units.
+uint16_t doorPosition() {
+    return (uint16_t)motion::interpolate(gDoorClosedPosition, gDoorOpenPosition, gDoorTravel);
+}
+
+uint8_t doorState() {
+    if (gControlEnabled) {
+        return DOOR_CONTROLLED;
+    }
+    if (gDoorMove.active()) {
+        return gDoorOpened ? DOOR_OPENING : DOOR_CLOSING;
+    }
+    return gDoorOpened ? DOOR_OPEN : DOOR_CLOSED;
+}
+
+void setDoorTravel(uint32_t travel) {
+    gDoorTravel = travel;
+    door.writeMicroseconds(motion::interpolate(servoPulse(gDoorClosedPosition), servoPulse(gDoorOpenPosition), travel));
+}
+
+// Moves the door from wherever it is, even mid-move, to travel.
+void startDoorMove(uint32_t travel, uint16_t ms, motion::profile shape) {
+    gDoorMoveFrom = gDoorTravel;
+    gDoorMoveTo = travel;
+    gDoorMove.start(millis(), ms, shape);
+    gDoorTask.start(DOOR_TICK_MS);
+}
+
+void moveDoor() {
+    uint32_t progress = gDoorMove.update(millis());
+    setDoorTravel(motion::interpolate(gDoorMoveFrom, gDoorMoveTo, progress));
+    if (!gDoorMove.active()) {
+        gDoorTask.stop();
+    }
+}
+
+// Call after enabling control or changing its gains. Takes over from
+// wherever the door is, stopping any move.
+void startControl() {
+    gDoorMove.stop();
+    gDoorTask.stop();
+    gPid.setGains(gControlGains[0], gControlGains[1], gControlGains[2], CONTROL_PERIOD_MS);
+    gPid.reset((int16_t)(gDoorTravel * control::Pid::OUTPUT_MAX / motion::ONE));
+    gControlInputValid = false;
+    gControlTask.start(CONTROL_PERIOD_MS);
+}
+
+// Safe state for a tripped alarm: the door opens to vent as fast as the
+// servo goes, and temperature control, which would close it again, stops.
+// Both are saved, so a reset does not undo the trip; R E1 hands the door
+// back to the controller.
+void tripDoor() {
+    if (gControlEnabled) {
+        gControlEnabled = false;
+        gControlTask.stop();
+    }
+    startDoorMove(motion::ONE, 0, motion::profile::LINEAR);
+    gDoorOpened = true;
+    saveConfig();
 }
 
 void setup()
 {
-  Serial.begin(115200);
+  Serial.begin(SERIAL_BAUD);
 
   SPI.begin();
-  SPI.setDataMode(SPI_MODE1);
+  sensor_bank::begin();
+  for (uint8_t i = 0; i < NUMBER_OF_SENSORS; i++) {
+      sensors[i].tc = tc(i);
+      sensors[i].found = slot::LIVE;    // until the first sweep says otherwise
+  }
 
   door.attach(DOOR_PWM_PIN);
 
 #ifdef DEBUG_FIRMWARE
-  Serial.print("# ");
+  Serial.print(F("# "));
   Serial.print(NUMBER_OF_SENSORS);
-  Serial.print(" Channel Thermocouple Board. Version: ");
-  Serial.println(FIRMWARE_VERSION);
+  Serial.print(F(" Channel Thermocouple Board. Version: "));
+  Serial.println(F(FIRMWARE_VERSION));
 #endif
 
-  validate_eeprom();
+  loadConfig();
+  updateSweepChannels();
+  setDoorTravel(gDoorOpened ? motion::ONE : 0);
+  if (gControlEnabled) {
+      startControl();
+  }
+
+  gFrame.part = FRAME_DONE;   // no frame going out
+  gCommandTask.start(0);
+  gSampleTask.start(0);
+  restartStreaming();
+
+  sample_timer::begin(sampleTick);
 }
 
-void processCommand() {
-#ifdef DEBUG_FIRMWARE
-    Serial.print("# Received Command: ");
-    uint8_t i = 0;
-    while (i < MAX_CMD_BUF_SIZE) {
-        Serial.print(gCommandBuffer[i]);
-        if (gCommandBuffer[i] == ';') {
-            break;
+// Bit i set for every channel that is read, streamed and reported: enabled
+// and, with discovery on, found live.
+uint8_t activeChannels() {
+    uint8_t channels = 0;
+    for (uint8_t i = 0; i < NUMBER_OF_SENSORS; i++) {
+        if (sensors[i].enabled && (!gDiscoveryEnabled || sensors[i].found == slot::LIVE)) {
+            channels |= 1 << i;
         }
-        i++;
     }
-    Serial.println("");
-#endif
+    return channels;
+}
 
-    int cmd = gCommandBuffer[0];
+// Call after any change to the enabled channels, discovery or what a
+// sweep found.
+void updateSweepChannels() {
+    gSweepChannels = activeChannels();
+}
 
-    switch (cmd) {
-        case 'T':
-        {
-            // Temperature Commands
-            // T E0; enable channel 0 all channels are enabled by default.
-            // T D0; disable channel 0
-            // T ONESHOT; read and return sensor values once.
-            // T S1 500; turn streaming mode on with a delay of 500 ms between readings.
-            // T S0; turn streaming mode off
-            int sub_cmd = gCommandBuffer[2];
-
-            switch (sub_cmd) {
-                case 'E': {
-                    int channel = gCommandBuffer[3] - '0';
-
-                    if (channel >= NUMBER_OF_SENSORS) {
-                        Serial.println("# Invalid channel number");
-                        return;
-                    }
-                    sensors[channel].enabled = true;
-                    EEPROM.write(EEPROM_SENSOR_ENABLED_OFFSET + channel, 1);
-
-                    #ifdef DEBUG_FIRMWARE
-                    Serial.print("# Enabled channel ");
-                    Serial.println(channel);
-                    #endif
-
-                } return;
-                case 'D': {
-                    int channel = gCommandBuffer[3] - '0';
-
-                    if (channel >= NUMBER_OF_SENSORS) {
-                        Serial.println("# Invalid channel number");
-                        return;
-                    }
-                    sensors[channel].enabled = false;
-                    EEPROM.write(EEPROM_SENSOR_ENABLED_OFFSET + channel, 0);
-
-                    #ifdef DEBUG_FIRMWARE
-                    Serial.print("# Disabled channel ");
-                    Serial.println(channel);
-                    #endif
-
-                } return;
-                case 'O': {
-                    for (uint8_t i = 0; i < NUMBER_OF_SENSORS; i++) {
-                        if(sensors[i].enabled) {
-                            sensors[i].tc.update();
-                        }
-                    }
-                    Serial.print("{ \"temperature\": [");
-                    bool printed = false;
-                    for (uint8_t i = 0; i < NUMBER_OF_SENSORS; i++) {
-                        if(sensors[i].enabled) {
-                            if (printed) {
-                                Serial.print(',');
-                            }
-                            Serial.print(sensors[i].tc.toJson());
-                            printed = true;
-                        }
-                    }
-                    Serial.println("]}");
-                } return;
-                case 'S': {
-                    int state = gCommandBuffer[3] - '0';
-                    
-                    if (state == 0) {
-                        gStreamingTemperatureEnabled = false;
-                    }
-                    else if (state == 1) {
-                        gStreamingTemperatureEnabled = true;
-                        gStreamingStatusEnabled = false;
-                        long delay = strtol(&gCommandBuffer[4], NULL, 10);
-                        gStreamingDelay = (uint16_t)delay;
-                    }
-                    else {
-                        Serial.print("# Unknown state value: ");
-                        Serial.print(state, DEC);
-                    }
-                    // Save to EEPROM
-                    EEPROM.write(EEPROM_STREAM_TEMPERATURE_OFFSET, gStreamingTemperatureEnabled ? 1 : 0);
-                    EEPROM.write(EEPROM_STREAMING_DELAY_OFFSET, gStreamingDelay);
-                    EEPROM.write(EEPROM_STREAMING_DELAY_OFFSET + 1, gStreamingDelay >> 8);
-                } return;
-            }
-            return;
+// Bit i set for every active channel whose status changed or whose value
+// moved further than its deadband since it was last reported.
+uint8_t changedChannels() {
+    uint8_t active = activeChannels();
+    uint8_t channels = 0;
+    for (uint8_t i = 0; i < NUMBER_OF_SENSORS; i++) {
+        temperature_sensor &s = sensors[i];
+        if (!(active & (1 << i))) {
+            continue;
         }
-        case 'D':
-        {
-            // Door Controls
-            // D C 23 120; configure the closed and open values for the door.
-            // D O1500; open the door over a 1500 ms duration.
-            // D S750; shut the door over a 750ms duration.
-            uint8_t sub_command = gCommandBuffer[2];
-
-            switch (sub_command) {
-                case 'C': {
-                    long temp = strtol(&gCommandBuffer[4], NULL, 10);
-                    gDoorClosedPosition = (uint16_t)temp;
-
-                    // find start of next number
-                    uint8_t idx = 4;
-                    while (gCommandBuffer[idx] != ' ') {
-                        idx++;
-                    }
-                    temp = strtol(&gCommandBuffer[idx], NULL, 10);
-                    gDoorOpenPosition = (uint16_t)temp;
-
-                    EEPROM.write(EEPROM_DOOR_CLOSED_OFFSET, gDoorClosedPosition);
-                    EEPROM.write(EEPROM_DOOR_CLOSED_OFFSET + 1, gDoorClosedPosition >> 8);
-                    EEPROM.write(EEPROM_DOOR_OPEN_OFFSET, gDoorOpenPosition);
-                    EEPROM.write(EEPROM_DOOR_OPEN_OFFSET + 1, gDoorOpenPosition >> 8);
-                } return;
-                case 'O': {
-                    if (gDoorOpened) {
-                        return; // can't open the door twice.
-                    }
-                    long ms = strtol(&gCommandBuffer[3], NULL, 10);
-                    long pause = ms / DOOR_MOVEMENT_STEPS;
-                    uint16_t step = (gDoorOpenPosition - gDoorClosedPosition) / DOOR_MOVEMENT_STEPS;
-                    
-                    for (uint16_t pos = gDoorClosedPosition; pos <= gDoorOpenPosition; pos += step) { 
-                        door.write(pos);
-                        delay(pause);
-                    }
-                    door.write(gDoorOpenPosition);
-                    
-                    gDoorOpened = true;
-                    EEPROM.write(EEPROM_DOOR_IS_OPEN_OFFSET, 1);
-                } return;
-                case 'S': {
-                    if (!gDoorOpened) {
-                        return; // can't close the door twice.
-                    }
-                    long ms = strtol(&gCommandBuffer[3], NULL, 10);
-                    long pause = ms / DOOR_MOVEMENT_STEPS;
-                    uint16_t step = (gDoorOpenPosition - gDoorClosedPosition) / DOOR_MOVEMENT_STEPS;
-                    
-                    for (uint16_t pos = gDoorOpenPosition; pos >= gDoorClosedPosition; pos -= step) { 
-                        door.write(pos);
-                        delay(pause);
-                    }
-                    door.write(gDoorClosedPosition);
-                    
-                    gDoorOpened = true;
-                    EEPROM.write(EEPROM_DOOR_IS_OPEN_OFFSET, 0);
-                }
-            }
+        int16_t delta = s.tc.getRawTemperature() - s.reported_value;
+        if (s.tc.getStatus() != s.reported_status || abs(delta) > s.deadband) {
+            channels |= 1 << i;
+        }
+    }
+    return channels;
+}
 
-            return;
+void markReported(uint8_t channels) {
+    gFreshChannels &= ~channels;
+    for (uint8_t i = 0; i < NUMBER_OF_SENSORS; i++) {
+        if (channels & (1 << i)) {
+            sensors[i].reported_value = sensors[i].tc.getRawTemperature();
+            sensors[i].reported_status = sensors[i].tc.getStatus();
         }
-        case 'S':
-        {
-            // Status Control
-            // S1 500; turn on streaming status. returns json of temperature and door
-            // S0; turn off streaming status mode.
-            uint8_t state = gCommandBuffer[3] - '0';
+    }
+}
 
-            if (state == 1) {
-                long delay = strtol(&gCommandBuffer[4], NULL, 10);
+// Writes the records of the given channels, comma separated, without
+// building any intermediate strings.
+void printTemperatureRecords(Print &out, uint8_t channels) {
+    bool printed = false;
+    for (uint8_t i = 0; i < NUMBER_OF_SENSORS; i++) {
+        if (channels & (1 << i)) {
+            if (printed) {
+                out.print(',');
+            }
+            sensors[i].tc.printJson(out);
+            printed = true;
+        }
+    }
+}
 
-                gStreamingDelay = (uint16_t)delay;
-                gStreamingStatusEnabled = true;
-                gStreamingTemperatureEnabled = false;
+// Writes the given channels, and optionally the door, as binary frames.
+// See binary_frame.h for the layout.
+void printBinaryFrames(Print &out, uint32_t sequence, uint8_t channels, bool door) {
+    if (channels) {
+        protocol::binary::Frame temperatures(protocol::binary::frame_type::TEMPERATURE);
+        temperatures.add(sequence);
+        uint8_t *count = temperatures.reserve(1);
+        *count = 0;
+        for (uint8_t i = 0; i < NUMBER_OF_SENSORS; i++) {
+            if (channels & (1 << i)) {
+                sensors[i].tc.writeRecord(temperatures.reserve(tc::RECORD_LENGTH));
+                (*count)++;
             }
-            else if (state == 0) {
-                gStreamingStatusEnabled = false;
+        }
+        temperatures.write(out);
+    }
+
+    if (door) {
+        protocol::binary::Frame status(protocol::binary::frame_type::DOOR);
+        status.add(sequence);
+        status.add(doorState());
+        status.add(doorPosition());
+        status.write(out);
+    }
+}
+
+const __FlashStringHelper *doorStateName(uint8_t state) {
+    switch (state) {
+        case DOOR_OPEN: return F("open");
+        case DOOR_CLOSING: return F("closing");
+        case DOOR_OPENING: return F("opening");
+        case DOOR_CONTROLLED: return F("control");
+        default: return F("closed");
+    }
+}
+
+// "control": {...} for status frames and R R. Output and terms are in
+// permille of door travel; input is null while no control channel reads OK.
+void printControl(Print &out) {
+    out.print(F("\"control\": {\"enabled\": "));
+    out.print(gControlEnabled ? 1 : 0, DEC);
+    out.print(F(", \"setpoint\": "));
+    fixed::print(out, gControlSetpoint, fixed::QUARTER_DEGREES);
+    out.print(F(", \"input\": "));
+    if (gControlInputValid) {
+        fixed::print(out, gControlInput, fixed::QUARTER_DEGREES);
+    }
+    else {
+        out.print(F("null"));
+    }
+    out.print(F(", \"output\": "));
+    out.print(gPid.output(), DEC);
+    out.print(F(", \"p\": "));
+    out.print(gPid.proportional(), DEC);
+    out.print(F(", \"i\": "));
+    out.print(gPid.integral(), DEC);
+    out.print(F(", \"d\": "));
+    out.print(gPid.derivative(), DEC);
+    out.print('}');
+}
+
+void printBinaryControl(Print &out, uint32_t sequence) {
+    protocol::binary::Frame control(protocol::binary::frame_type::CONTROL);
+    control.add(sequence);
+    control.add((uint8_t)((gControlEnabled ? 1 : 0) | (gControlInputValid ? 2 : 0)));
+    control.add(gControlSetpoint);
+    control.add(gControlInput);
+    control.add(gPid.output());
+    control.add(gPid.proportional());
+    control.add(gPid.integral());
+    control.add(gPid.derivative());
+    control.write(out);
+}
+
+const __FlashStringHelper *alarmConditionName(uint8_t condition) {
+    switch (condition) {
+        case safety::OVER: return F("over");
+        case safety::UNDER: return F("under");
+        case safety::RISE: return F("rise");
+        default: return F("fault");
+    }
+}
+
+void printAlarmEvent(Print &out, const alarm_event &event) {
+    if (gStreamingBinary) {
+        protocol::binary::Frame frame(protocol::binary::frame_type::ALARM);
+        frame.add(event.channel);
+        frame.add(event.condition);
+        frame.add((uint8_t)(event.active ? 1 : 0));
+        frame.add((uint8_t)event.status);
+        frame.add(event.value);
+        frame.add(event.time);
+        frame.write(out);
+        return;
+    }
+    out.print(F("{ \"alarm\": {\"channel\": "));
+    out.print(event.channel, DEC);
+    out.print(F(", \"condition\": \""));
+    out.print(alarmConditionName(event.condition));
+    out.print(F("\", \"active\": "));
+    out.print(event.active ? 1 : 0, DEC);
+    out.print(F(", \"status_code\": "));
+    out.print(event.status, DEC);
+    out.print(F(", \"value\": "));
+    fixed::print(out, event.value, fixed::QUARTER_DEGREES);
+    out.print(F(", \"time\": "));
+    out.print(event.time, DEC);
+    out.println(F("}}"));
+}
+
+using command::error;
+
+error parseChannel(const command::Args &args, uint8_t i, uint8_t &channel) {
+    long value;
+    error status = args.integer(i, 0, NUMBER_OF_SENSORS - 1, value);
+    if (status == error::INVALID_ARGUMENT) {
+        return error::INVALID_CHANNEL;
+    }
+    channel = (uint8_t)value;
+    return status;
+}
+
+// Temperature Commands
+// T E0; enable channel 0 all channels are enabled by default.
+// T D0; disable channel 0
+// T ONESHOT; return the newest reading of every channel once, with the
+//           device time to tell their age from.
+// T S1 500; turn streaming mode on with a delay of 500 ms between readings.
+// T S2 500; same, as binary frames instead of json.
+// T S0; turn streaming mode off
+// T Q; report the sampler queue: depth and dropped frames.
+// T C1 10000; stream only channels that changed, with a full frame every 10000 ms.
+// T C0; stream every channel in every frame again.
+// T B0 4; channel 0 is only resent once it moves more than 4 counts (1.00 C).
+// T A1; channel discovery on (default): channels without a chip or a
+//       thermocouple are left out of sweeps and frames until one turns up.
+// T A0; channel discovery off: every enabled channel is read and sent.
+// T P; report what discovery last found on each channel.
+// T L; report the link: baud, bytes in a full frame, the shortest streaming
+//      delay and highest frame rate the link keeps up with, and the
+//      coalesced and dropped frames.
+// T F0 1; filter channel 0: 0 none (default), 1 median of 3, 2 median of 5,
+//         3 low pass.
+// T F0 3 32; low pass with alpha 32/256: each sample moves the reading an
+//            eighth of the way.
+// T F0; report the filter settings of channel 0.
+// T N0 4; channel 0 publishes the average of every 4 conversions, before
+//         the filter. 1 (the default) to 8.
+// T R0 5000; read channel 0 every 5000 ms. 100, a reading per conversion,
+//            is the default and the shortest. Streamed frames carry only
+//            the channels read since the last frame.
+// T R0; report the sampling period of channel 0.
+
+error setChannelEnabled(const command::Args &args, bool enabled) {
+    uint8_t channel;
+    error status = parseChannel(args, 0, channel);
+    if (status != error::NONE) {
+        return status;
+    }
+    sensors[channel].enabled = enabled;
+    updateSweepChannels();
+    saveConfig();
+
+    #ifdef DEBUG_FIRMWARE
+    Serial.print(enabled ? F("# Enabled channel ") : F("# Disabled channel "));
+    Serial.println(channel);
+    #endif
+    return error::NONE;
+}
+
+error temperatureEnable(const command::Args &args) {
+    return setChannelEnabled(args, true);
+}
+
+error temperatureDisable(const command::Args &args) {
+    return setChannelEnabled(args, false);
+}
+
+// Longest T ONESHOT is deferred for channels with no reading yet: a conversion
+// for each of the most oversampled ones, and one to spare.
+#define ONESHOT_WAIT_MS ((sensor::temperature::Filter::MAX_OVERSAMPLING + 1) * tc::CONVERSION_TIME_US / 1000)
+
+// millis() when the command being processed had come in.
+uint32_t gCommandArrived = 0;
+
+error temperatureOneshot(const command::Args &args) {
+    // Straight after boot the cache holds no reading yet. The command is
+    // then deferred, not the firmware, until the sampler has one.
+    if ((activeChannels() & ~gReadChannels) && millis() - gCommandArrived < ONESHOT_WAIT_MS) {
+        return error::BUSY;
+    }
+    // Each record carries the time it was read, and channels with a long
+    // sampling period can be well behind.
+    Serial.print(F("{ \"time\": "));
+    Serial.print(millis(), DEC);
+    Serial.print(F(", \"temperature\": ["));
+    printTemperatureRecords(Serial, activeChannels());
+    Serial.println(F("]}"));
+    return error::NONE;
+}
+
+error temperatureQueue(const command::Args &args) {
+    Serial.print(F("{ \"sampler\": {\"queued\": "));
+    Serial.print(gSampleQueue.size(), DEC);
+    Serial.print(F(", \"overflows\": "));
+    Serial.print(gSampleQueue.overflows(), DEC);
+    Serial.println(F("}}"));
+    return error::NONE;
+}
+
+error temperatureDiscovery(const command::Args &args) {
+    long state;
+    error status = args.integer(0, 0, 1, state);
+    if (status != error::NONE) {
+        return status;
+    }
+    gDiscoveryEnabled = state == 1;
+    updateSweepChannels();
+    saveConfig();
+    return error::NONE;
+}
+
+void printSlotChannels(slot found) {
+    bool printed = false;
+    Serial.print('[');
+    for (uint8_t i = 0; i < NUMBER_OF_SENSORS; i++) {
+        if (sensors[i].found == found) {
+            if (printed) {
+                Serial.print(F(", "));
             }
-            
-            // Save to EEPROM
-            EEPROM.write(EEPROM_STREAM_STATUS_OFFSET, gStreamingStatusEnabled ? 1 : 0);
-            EEPROM.write(EEPROM_STREAMING_DELAY_OFFSET, gStreamingDelay);
-            EEPROM.write(EEPROM_STREAMING_DELAY_OFFSET + 1, gStreamingDelay >> 8);
+            Serial.print(i, DEC);
+            printed = true;
         }
     }
+    Serial.print(']');
 }
 
-void loop()
+error temperatureProbe(const command::Args &args) {
+    Serial.print(F("{ \"discovery\": {\"enabled\": "));
+    Serial.print(gDiscoveryEnabled ? 1 : 0, DEC);
+    Serial.print(F(", \"live\": "));
+    printSlotChannels(slot::LIVE);
+    Serial.print(F(", \"open\": "));
+    printSlotChannels(slot::OPEN);
+    Serial.print(F(", \"absent\": "));
+    printSlotChannels(slot::ABSENT);
+    Serial.println(F("}}"));
+    return error::NONE;
+}
+
+error temperatureLink(const command::Args &args) {
+    stream_frame full = { FRAME_HEADER, activeChannels(), true, gStreamingStatusEnabled, gStreamingBinary, gFrameSequence };
+    CountingPrint counter;
+    while (renderPiece(counter, full, false)) {
+    }
+    uint32_t bits = (uint32_t)counter.count() * 10 * 1000;   // 8N1, in ms
+
+    Serial.print(F("{ \"link\": {\"baud\": "));
+    Serial.print((uint32_t)SERIAL_BAUD, DEC);
+    Serial.print(F(", \"frame_bytes\": "));
+    Serial.print(counter.count(), DEC);
+    Serial.print(F(", \"min_period_ms\": "));
+    Serial.print((bits + SERIAL_BAUD - 1) / SERIAL_BAUD, DEC);
+    // frames per second, in hundredths
+    uint32_t rate = (uint32_t)SERIAL_BAUD * 10 / counter.count();
+    Serial.print(F(", \"max_rate\": "));
+    Serial.print(rate / 100, DEC);
+    Serial.print(rate % 100 < 10 ? F(".0") : F("."));
+    Serial.print(rate % 100, DEC);
+    Serial.print(F(", \"coalesced\": "));
+    Serial.print(gFramesCoalesced, DEC);
+    Serial.print(F(", \"dropped\": "));
+    Serial.print(gFramesDropped, DEC);
+    Serial.println(F("}}"));
+    return error::NONE;
+}
+
+error temperatureStream(const command::Args &args) {
+    long state;
+    error status = args.integer(0, 0, 2, state);
+    if (status != error::NONE) {
+        return status;
+    }
+
+    if (state == 0) {
+        gStreamingTemperatureEnabled = false;
+    }
+    else {
+        long delay;
+        status = args.integer(1, 0, 65535, delay);
+        if (status != error::NONE) {
+            return status;
+        }
+        gStreamingTemperatureEnabled = true;
+        gStreamingStatusEnabled = false;
+        gStreamingBinary = state == 2;
+        gStreamingDelay = (uint16_t)delay;
+    }
+    restartStreaming();
+
+    saveConfig();
+    return error::NONE;
+}
+
+error temperatureChangesOnly(const command::Args &args) {
+    long state;
+    error status = args.integer(0, 0, 1, state);
+    if (status != error::NONE) {
+        return status;
+    }
+    if (state == 1) {
+        long keepAlive;
+        status = args.integer(1, MIN_KEEPALIVE_DELAY, 65535, keepAlive);
+        if (status != error::NONE) {
+            return status;
+        }
+        gKeepAliveDelay = (uint16_t)keepAlive;
+    }
+    gStreamingChangesOnly = state == 1;
+    restartStreaming();
+
+    saveConfig();
+    return error::NONE;
+}
+
+error temperatureDeadband(const command::Args &args) {
+    uint8_t channel;
+    error status = parseChannel(args, 0, channel);
+    if (status != error::NONE) {
+        return status;
+    }
+    long deadband;
+    status = args.integer(1, 0, 254, deadband);
+    if (status != error::NONE) {
+        return status;
+    }
+    sensors[channel].deadband = (uint8_t)deadband;
+    saveConfig();
+    return error::NONE;
+}
+
+void printFilter(uint8_t channel) {
+    const sensor::temperature::Filter &f = sensors[channel].tc.filter();
+    Serial.print(F("{ \"filter\": {\"channel\": "));
+    Serial.print(channel, DEC);
+    Serial.print(F(", \"mode\": "));
+    Serial.print((uint8_t)f.mode(), DEC);
+    Serial.print(F(", \"alpha\": "));
+    Serial.print(f.alpha(), DEC);
+    Serial.print(F(", \"oversampling\": "));
+    Serial.print(f.oversampling(), DEC);
+    Serial.println(F("}}"));
+}
+
+error temperatureFilter(const command::Args &args) {
+    uint8_t channel;
+    error status = parseChannel(args, 0, channel);
+    if (status != error::NONE) {
+        return status;
+    }
+    if (args.count() < 2) {
+        printFilter(channel);
+        return error::NONE;
+    }
+    sensor::temperature::Filter &f = sensors[channel].tc.filter();
+    long mode;
+    status = args.integer(1, 0, 3, mode);
+    if (status != error::NONE) {
+        return status;
+    }
+    long alpha = f.alpha();
+    if (args.count() > 2) {
+        status = args.integer(2, 1, 255, alpha);
+        if (status != error::NONE) {
+            return status;
+        }
+    }
+    f.configure((sensor::temperature::filter_mode)mode, (uint8_t)alpha, f.oversampling());
+    saveConfig();
+    return error::NONE;
+}
+
+error temperatureOversampling(const command::Args &args) {
+    uint8_t channel;
+    error status = parseChannel(args, 0, channel);
+    if (status != error::NONE) {
+        return status;
+    }
+    long count;
+    status = args.integer(1, 1, sensor::temperature::Filter::MAX_OVERSAMPLING, count);
+    if (status != error::NONE) {
+        return status;
+    }
+    sensor::temperature::Filter &f = sensors[channel].tc.filter();
+    f.configure(f.mode(), f.alpha(), (uint8_t)count);
+    saveConfig();
+    return error::NONE;
+}
+
+error temperaturePeriod(const command::Args &args) {
+    uint8_t channel;
+    error status = parseChannel(args, 0, channel);
+    if (status != error::NONE) {
+        return status;
+    }
+    if (args.count() < 2) {
+        Serial.print(F("{ \"period\": {\"channel\": "));
+        Serial.print(channel, DEC);
+        Serial.print(F(", \"ms\": "));
+        Serial.print(gPlanner.period(channel), DEC);
+        Serial.println(F("}}"));
+        return error::NONE;
+    }
+    long period;
+    status = args.integer(1, gPlanner.MIN_PERIOD_MS, 65535, period);
+    if (status != error::NONE) {
+        return status;
+    }
+    gPlanner.setPeriod(channel, (uint16_t)period);
+    saveConfig();
+    return error::NONE;
+}
+
+// Door Controls
+// D C 23 120; configure the closed and open values for the door.
+// D O1500; open the door over a 1500 ms duration.
+// D S750; shut the door over a 750ms duration.
+// D O1500 1; same, with a motion profile: 0 linear, 1 trapezoidal, 2 ease
+//            in and out (the default).
+// Moves run in the background and a new one starts from wherever the door
+// is, so D S can turn back a door that is still opening. D O and D S fail
+// while temperature control (R E1) drives the door.
+
+error doorConfigure(const command::Args &args) {
+    long closed, open;
+    error status = args.integer(0, 0, 65535, closed);
+    if (status == error::NONE) {
+        status = args.integer(1, 0, 65535, open);
+    }
+    if (status != error::NONE) {
+        return status;
+    }
+    gDoorClosedPosition = (uint16_t)closed;
+    gDoorOpenPosition = (uint16_t)open;
+
+    saveConfig();
+    return error::NONE;
+}
+
+error doorMove(const command::Args &args, bool open) {
+    long ms;
+    error status = args.integer(0, 0, 65535, ms);
+    if (status != error::NONE) {
+        return status;
+    }
+    long shape = (long)motion::profile::EASE_IN_OUT;
+    if (args.count() > 1) {
+        status = args.integer(1, 0, 2, shape);
+        if (status != error::NONE) {
+            return status;
+        }
+    }
+    startDoorMove(open ? motion::ONE : 0, (uint16_t)ms, (motion::profile)shape);
+
+    gDoorOpened = open;
+    saveConfig();
+    return error::NONE;
+}
+
+error doorOpen(const command::Args &args) {
+    if (gDoorOpened || gControlEnabled) {
+        return error::INVALID_STATE; // can't open the door twice.
+    }
+    return doorMove(args, true);
+}
+
+error doorShut(const command::Args &args) {
+    if (!gDoorOpened || gControlEnabled) {
+        return error::INVALID_STATE; // can't close the door twice.
+    }
+    return doorMove(args, false);
+}
+
+// History
+// H S0; running min, max, mean and ema of channel 0.
+// H W0; the samples still held for channel 0, with millis() timestamps.
+// H R0; clear the history and statistics of channel 0.
+
+error historyStats(const command::Args &args) {
+    uint8_t channel;
+    error status = parseChannel(args, 0, channel);
+    if (status == error::NONE) {
+        sensors[channel].history.printStats(Serial, channel);
+    }
+    return status;
+}
+
+error historyWindow(const command::Args &args) {
+    uint8_t channel;
+    error status = parseChannel(args, 0, channel);
+    if (status == error::NONE) {
+        sensors[channel].history.printWindow(Serial, channel, millis());
+    }
+    return status;
+}
+
+error historyReset(const command::Args &args) {
+    uint8_t channel;
+    error status = parseChannel(args, 0, channel);
+    if (status == error::NONE) {
+        sensors[channel].history.reset();
+    }
+    return status;
+}
+
+// Status Control
+// S1 500; turn on streaming status. returns json of temperature, door and
+//         temperature control (see R).
+// S2 500; same, as binary temperature, door and control frames.
+// S0; turn off streaming status mode.
+
+error statusStream(const command::Args &args) {
+    long state;
+    error status = args.integer(0, 0, 2, state);
+    if (status != error::NONE) {
+        return status;
+    }
+
+    if (state == 0) {
+        gStreamingStatusEnabled = false;
+    }
+    else {
+        long delay;
+        status = args.integer(1, 0, 65535, delay);
+        if (status != error::NONE) {
+            return status;
+        }
+        gStreamingDelay = (uint16_t)delay;
+        gStreamingStatusEnabled = true;
+        gStreamingTemperatureEnabled = false;
+        gStreamingBinary = state == 2;
+    }
+    restartStreaming();
+
+    saveConfig();
+    return error::NONE;
+}
+
+// Temperature Control
+// R E1; drive the door from the PID; R E0 stops and leaves the door where it is.
+// R S 800; setpoint in 0.25 C counts (200.00 C).
+// R G 20000 500 0; kp, ki and kd in thousandths of a permille of door travel
+//                  per C, per C*s and per C/s (20.0, 0.5 and 0).
+// R C 0 1 2; control on the average of channels 0, 1 and 2.
+// R R; report the controller state.
+
+error controlEnable(const command::Args &args) {
+    long state;
+    error status = args.integer(0, 0, 1, state);
+    if (status != error::NONE) {
+        return status;
+    }
+    if (state == 1 && !gControlEnabled) {
+        gControlEnabled = true;
+        startControl();
+    }
+    else if (state == 0 && gControlEnabled) {
+        gControlEnabled = false;
+        gControlTask.stop();
+        gDoorOpened = gDoorTravel > motion::ONE / 2;
+    }
+    saveConfig();
+    return error::NONE;
+}
+
+error controlSetpoint(const command::Args &args) {
+    long setpoint;
+    error status = args.integer(0, -1000, 7000, setpoint);
+    if (status != error::NONE) {
+        return status;
+    }
+    gControlSetpoint = (int16_t)setpoint;
+    saveConfig();
+    return error::NONE;
+}
+
+error controlGains(const command::Args &args) {
+    long gains[3];
+    for (uint8_t i = 0; i < 3; i++) {
+        error status = args.integer(i, 0, control::Pid::MAX_GAIN, gains[i]);
+        if (status != error::NONE) {
+            return status;
+        }
+    }
+    for (uint8_t i = 0; i < 3; i++) {
+        gControlGains[i] = (uint32_t)gains[i];
+    }
+    gPid.setGains(gControlGains[0], gControlGains[1], gControlGains[2], CONTROL_PERIOD_MS);
+    saveConfig();
+    return error::NONE;
+}
+
+error controlChannels(const command::Args &args) {
+    if (args.count() == 0) {
+        return error::MISSING_ARGUMENT;
+    }
+    uint8_t channels = 0;
+    for (uint8_t i = 0; i < args.count(); i++) {
+        uint8_t channel;
+        error status = parseChannel(args, i, channel);
+        if (status != error::NONE) {
+            return status;
+        }
+        channels |= 1 << channel;
+    }
+    gControlChannels = channels;
+    saveConfig();
+    return error::NONE;
+}
+
+error controlReport(const command::Args &args) {
+    Serial.print(F("{ "));
+    printControl(Serial);
+    Serial.println('}');
+    return error::NONE;
+}
+
+// Alarms
+// A C0 4800 0 8 8; channel 0: high 1200 C, low 0 C, rate of rise 2 C/s and
+//                  hysteresis 2 C, all in 0.25 C counts (per second for
+//                  the rate). The rate and hysteresis are optional.
+// A E0 9 1; arm over-temperature (1) and fault (8) on channel 0, and open
+//           the door when the over-temperature alarm goes off. Conditions
+//           are bits: 1 over, 2 under, 4 rise, 8 fault. A E0 0 disarms.
+// A S; report the alarms of every channel and the events dropped.
+// A raised or cleared condition is sent at once as an alarm event, see
+// gAlarmEvents. A trip opens the door and turns temperature control off.
+
+error alarmConfigure(const command::Args &args) {
+    uint8_t channel;
+    error status = parseChannel(args, 0, channel);
+    if (status != error::NONE) {
+        return status;
+    }
+    safety::Alarm &a = sensors[channel].alarm;
+    long high, low;
+    long rise = a.rise();
+    long hysteresis = a.hysteresis();
+    status = args.integer(1, -1000, 7000, high);
+    if (status == error::NONE) {
+        status = args.integer(2, -1000, 7000, low);
+    }
+    if (status == error::NONE && args.count() > 3) {
+        status = args.integer(3, 0, 255, rise);
+    }
+    if (status == error::NONE && args.count() > 4) {
+        status = args.integer(4, 0, 255, hysteresis);
+    }
+    if (status != error::NONE) {
+        return status;
+    }
+    if (low > high) {
+        return error::INVALID_ARGUMENT;
+    }
+    a.configure((int16_t)high, (int16_t)low, (uint8_t)rise, (uint8_t)hysteresis);
+    saveConfig();
+    return error::NONE;
+}
+
+error alarmArm(const command::Args &args) {
+    uint8_t channel;
+    error status = parseChannel(args, 0, channel);
+    if (status != error::NONE) {
+        return status;
+    }
+    long armed;
+    long trips = 0;
+    status = args.integer(1, 0, safety::ALL, armed);
+    if (status == error::NONE && args.count() > 2) {
+        status = args.integer(2, 0, safety::ALL, trips);
+    }
+    if (status != error::NONE) {
+        return status;
+    }
+    sensors[channel].alarm.arm((uint8_t)armed, (uint8_t)trips);
+    saveConfig();
+    return error::NONE;
+}
+
+error alarmReport(const command::Args &args) {
+    Serial.print(F("{ \"alarms\": ["));
+    for (uint8_t i = 0; i < NUMBER_OF_SENSORS; i++) {
+        const safety::Alarm &a = sensors[i].alarm;
+        if (i > 0) {
+            Serial.print(',');
+        }
+        Serial.print(F("{\"channel\": "));
+        Serial.print(i, DEC);
+        Serial.print(F(", \"armed\": "));
+        Serial.print(a.armed(), DEC);
+        Serial.print(F(", \"trips\": "));
+        Serial.print(a.trips(), DEC);
+        Serial.print(F(", \"active\": "));
+        Serial.print(a.active(), DEC);
+        Serial.print(F(", \"high\": "));
+        fixed::print(Serial, a.high(), fixed::QUARTER_DEGREES);
+        Serial.print(F(", \"low\": "));
+        fixed::print(Serial, a.low(), fixed::QUARTER_DEGREES);
+        Serial.print(F(", \"rise\": "));
+        fixed::print(Serial, a.rise(), fixed::QUARTER_DEGREES);
+        Serial.print(F(", \"hysteresis\": "));
+        fixed::print(Serial, a.hysteresis(), fixed::QUARTER_DEGREES);
+        Serial.print(F(", \"rate\": "));
+        fixed::print(Serial, a.rate(), fixed::QUARTER_DEGREES);
+        Serial.print('}');
+    }
+    Serial.print(F("], \"dropped\": "));
+    Serial.print(gAlarmEvents.overflows(), DEC);
+    Serial.println('}');
+    return error::NONE;
+}
+
+// Clock
+// C 1234; reply with the device time (millis(), the time base of every
+//         sample timestamp), the sequence number of the last streamed frame
+//         and the token, which is optional. Noting when C was sent and when
+//         the reply arrived gives the host the round trip and the offset of
+//         the device clock; see the README.
+
+error clockSync(const command::Args &args) {
+    uint32_t now = millis();
+    long token = 0;
+    if (args.count() > 0) {
+        error status = args.integer(0, 0, 2147483647L, token);
+        if (status != error::NONE) {
+            return status;
+        }
+    }
+    Serial.print(F("{ \"clock\": {\"time\": "));
+    Serial.print(now, DEC);
+    Serial.print(F(", \"seq\": "));
+    Serial.print(gFrameSequence, DEC);
+    Serial.print(F(", \"token\": "));
+    Serial.print(token, DEC);
+    Serial.println(F("}}"));
+    return error::NONE;
+}
+
+#ifdef PROFILE_FIRMWARE
+// Profiling (builds with -DPROFILE_FIRMWARE only)
+// P; stage timings, dropped and late frames and free RAM since the last P.
+
+error profileReport(const command::Args &args) {
+    profile::report(Serial, gSampleQueue.overflows());
+    return error::NONE;
+}
+#endif
+
+// New commands only need a handler and a row here.
+const command::entry gCommands[] PROGMEM = {
+    { 'T', 'E', temperatureEnable },
+    { 'T', 'D', temperatureDisable },
+    { 'T', 'O', temperatureOneshot },
+    { 'T', 'Q', temperatureQueue },
+    { 'T', 'S', temperatureStream },
+    { 'T', 'C', temperatureChangesOnly },
+    { 'T', 'B', temperatureDeadband },
+    { 'T', 'A', temperatureDiscovery },
+    { 'T', 'P', temperatureProbe },
+    { 'T', 'L', temperatureLink },
+    { 'T', 'F', temperatureFilter },
+    { 'T', 'N', temperatureOversampling },
+    { 'T', 'R', temperaturePeriod },
+    { 'D', 'C', doorConfigure },
+    { 'D', 'O', doorOpen },
+    { 'D', 'S', doorShut },
+    { 'H', 'S', historyStats },
+    { 'H', 'W', historyWindow },
+    { 'H', 'R', historyReset },
+    { 'R', 'E', controlEnable },
+    { 'R', 'S', controlSetpoint },
+    { 'R', 'G', controlGains },
+    { 'R', 'C', controlChannels },
+    { 'R', 'R', controlReport },
+    { 'A', 'C', alarmConfigure },
+    { 'A', 'E', alarmArm },
+    { 'A', 'S', alarmReport },
+    { 'S', 0,   statusStream },
+    { 'C', 0,   clockSync }
+#ifdef PROFILE_FIRMWARE
+    ,
+    { 'P', 0,   profileReport }
+#endif
+};
+
+command::Parser gCommandParser;
+
+// The command's handler returned BUSY; it is run again on later passes.
+bool gCommandDeferred = false;
+
+// Returns false if the command is deferred.
+bool processCommand() {
+    PROFILE_SCOPE(COMMAND);
+    command::Args args = gCommandParser.args();
+
+#ifdef DEBUG_FIRMWARE
+    if (!gCommandDeferred) {
+        Serial.print(F("# Received Command:"));
+        for (uint8_t i = 0; i < args.count(); i++) {
+            Serial.print(' ');
+            Serial.print(args.at(i));
+        }
+        Serial.println();
+    }
+#endif
+
+    long id;
+    error status = args.request(id);
+    if (status == error::NONE) {
+        status = gCommandParser.status();
+    }
+    if (status == error::NONE && args.count() > 0) {
+        status = command::dispatch(gCommands, sizeof(gCommands) / sizeof(gCommands[0]), args);
+    }
+    gCommandDeferred = status == error::BUSY;
+    if (gCommandDeferred) {
+        return false;
+    }
+    if (id != command::NO_REQUEST) {
+        command::print_ack(Serial, status, id);
+    }
+    else if (status != error::NONE) {
+        command::print_error(Serial, status);
+    }
+    return true;
+}
+
+// A complete command is held, and no more input read, until the frame
+// going out reaches a line boundary, so its reply never lands inside a
+// frame: serviceTx() stops there, cutting a JSON frame short if it has to,
+// and the reply goes out between two pieces. A command so waits for one
+// piece, not the whole frame. It goes ahead of a pending frame, which
+// would otherwise keep a slow link busy for good. Commands pipelined
+// behind it that have already arrived run in the same pass, up to
+// COMMAND_BATCH, so a batch costs one wait for the link rather than one per
+// command, and a host that never stops sending still cannot starve the
+// stream.
+#define COMMAND_BATCH 8
+
+bool gCommandReady = false;
+
+// A command waits for a line boundary. A deferred one does not hold up the
+// stream and only runs again at the next boundary that comes.
+bool commandWaiting()
 {
-    while (Serial.available() > 0) {
-        int c = Serial.read();
+    return gCommandReady && !gCommandDeferred;
+}
 
-        gCommandBuffer[gCommandBufferIndex] = c;
-        gCommandBufferIndex++;
-        if (gCommandBufferIndex == MAX_CMD_BUF_SIZE) {
-            gCommandBufferIndex = 0;
+void serviceCommands()
+{
+    uint8_t processed = 0;
+    while (processed < COMMAND_BATCH) {
+        while (!gCommandReady && Serial.available() > 0) {
+            gCommandReady = gCommandParser.feed(Serial.read());
+            if (gCommandReady) {
+                gCommandArrived = millis();
+            }
+        }
+        if (!gCommandReady || !gTxBuffer.empty() || !atLineBoundary()) {
+            break;
         }
+        #ifdef DEBUG_FIRMWARE
+        if (gDebugLog.pending()) {
+            break;      // serviceTx() may be part way through a line
+        }
+        #endif
+        gCommandReady = false;
+        if (!processCommand()) {
+            gCommandReady = true;   // deferred, run again on a later pass
+            break;
+        }
+        processed++;
+    }
+    if (processed && gFramePending && !gTxTask.running()) {
+        gFramePending = false;
+        startFrame();
+    }
+}
 
-        if (c == '\n') {
-            processCommand();
-            gCommandBufferIndex = 0;
-        }        
+// Runs the alarms of a channel on its newest reading and queues an event
+// for every condition that was raised or cleared.
+void checkAlarms(uint8_t channel, uint32_t time, bool ok)
+{
+    temperature_sensor &s = sensors[channel];
+    uint8_t changed = s.alarm.update(time, ok, s.tc.getRawTemperature());
+    if (!changed) {
+        return;
     }
+    for (uint8_t condition = safety::OVER; condition & safety::ALL; condition <<= 1) {
+        if (changed & condition) {
+            alarm_event event = { time, s.tc.getRawTemperature(), channel, condition,
+                                  (s.alarm.active() & condition) != 0, (int8_t)s.tc.getStatus() };
+            gAlarmEvents.push(event);
+        }
+    }
+    if (!gTxTask.running()) {
+        gTxTask.start(0);
+    }
+    if (changed & s.alarm.active() & s.alarm.trips()) {
+        tripDoor();
+    }
+}
 
-    if (gStreamingStatusEnabled || gStreamingTemperatureEnabled) {
+void sampleSensors()
+{
+    raw_sweep sweep;
+    while (gSampleQueue.pop(sweep)) {
+        PROFILE_SCOPE(DECODE);
+        bool changed = false;
         for (uint8_t i = 0; i < NUMBER_OF_SENSORS; i++) {
-            if(sensors[i].enabled) {
-                sensors[i].tc.update();
+            if (!(sweep.channels & (1 << i))) {
+                continue;
+            }
+            temperature_sensor &s = sensors[i];
+            slot found = tc::classify(sweep.frames[i]);
+            if (found != s.found) {
+                s.found = found;
+                changed = true;
+                #ifdef DEBUG_FIRMWARE
+                gDebugLog.print(F("# Channel "));
+                gDebugLog.print(i, DEC);
+                gDebugLog.println(found == slot::LIVE ? F(" live.") : found == slot::OPEN ? F(" open.") : F(" absent."));
+                #endif
             }
+            if (!s.enabled || !(sweep.due & (1 << i))) {
+                continue;
+            }
+            #ifdef DEBUG_FIRMWARE
+            gDebugLog.print(F("# Read SPI value: "));
+            gDebugLog.println(sweep.frames[i]);
+            #endif
+            if (!s.tc.decode(sweep.frames[i], sweep.time)) {
+                continue;
+            }
+            gFreshChannels |= 1 << i;
+            gReadChannels |= 1 << i;
+            bool ok = s.tc.getStatus() == sensor::temperature::thermocouple::status::OK;
+            if (ok) {
+                s.history.add(sweep.time, s.tc.getRawTemperature());
+            }
+            if (s.alarm.armed()) {
+                checkAlarms(i, sweep.time, ok && found != slot::ABSENT);
+            }
+        }
+        if (changed) {
+            updateSweepChannels();
         }
+    }
+}
 
-        Serial.print("{ \"temperature\": [");
-        bool printed = false;
-        for (uint8_t i = 0; i < NUMBER_OF_SENSORS; i++) {
-            if(sensors[i].enabled) {
-                if (printed) {
-                    Serial.print(',');
+// One control step on the newest readings. With no control channel
+// reading OK the door is held where it is.
+void runControl()
+{
+    int32_t sum = 0;
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < NUMBER_OF_SENSORS; i++) {
+        temperature_sensor &s = sensors[i];
+        if ((gControlChannels & (1 << i)) && s.enabled &&
+            s.tc.getStatus() == sensor::temperature::thermocouple::status::OK) {
+            sum += s.tc.getRawTemperature();
+            count++;
+        }
+    }
+    gControlInputValid = count > 0;
+    if (!gControlInputValid) {
+        return;
+    }
+    gControlInput = (int16_t)(sum / count);
+    int16_t output = gPid.update(gControlSetpoint, gControlInput);
+    setDoorTravel((uint32_t)output * motion::ONE / control::Pid::OUTPUT_MAX);
+}
+
+// Works out what the next streamed frame carries and starts sending it.
+void startFrame()
+{
+    uint8_t channels = activeChannels() & gFreshChannels;
+    bool door = gStreamingStatusEnabled;
+
+    if (gStreamingChangesOnly) {
+        uint32_t now = millis();
+        if (gFullFrameDue || now - gLastFullFrame >= gKeepAliveDelay) {
+            gFullFrameDue = false;
+            gLastFullFrame = now;
+            channels = activeChannels();
+        }
+        else {
+            channels = changedChannels();
+            door = door && (doorState() != gReportedDoorState || doorPosition() != gReportedDoorPosition);
+        }
+    }
+    if (!channels && !door) {
+        return;
+    }
+
+    gFrame.part = FRAME_HEADER;
+    gFrame.channels = channels;
+    gFrame.first = true;
+    gFrame.door = door;
+    gFrame.binary = gStreamingBinary;
+    gFrame.sequence = ++gFrameSequence;
+    gTxTask.start(0);
+}
+
+void emitFrame()
+{
+    if (!gTxTask.running()) {
+        startFrame();
+    }
+    else if (!gStreamingDelay) {
+        gFramePending = true;
+    }
+    else if (!gFramePending) {
+        gFramePending = true;
+        gFramesCoalesced++;
+    }
+    else {
+        gFramesDropped++;
+    }
+}
+
+// Renders the next piece of a frame into out. Returns false, rendering
+// nothing, once the frame is complete. With report set, what is rendered is
+// marked as sent for change-only streaming.
+bool renderPiece(Print &out, stream_frame &frame, bool report)
+{
+    switch (frame.part) {
+        case FRAME_HEADER:
+            frame.part = FRAME_RECORDS;
+            if (!frame.binary) {
+                out.print(F("{ \"seq\": "));
+                out.print(frame.sequence, DEC);
+                out.print(F(", \"temperature\": ["));
+                return true;
+            }
+            printBinaryFrames(out, frame.sequence, frame.channels, false);
+            if (report) {
+                markReported(frame.channels);
+            }
+            frame.channels = 0;
+            return true;
+
+        case FRAME_RECORDS:
+            if (frame.channels) {
+                uint8_t channel = 0;
+                while (!(frame.channels & (1 << channel))) {
+                    channel++;
+                }
+                frame.channels &= ~(1 << channel);
+                if (!frame.first) {
+                    out.print(',');
+                }
+                frame.first = false;
+                sensors[channel].tc.printJson(out);
+                if (report) {
+                    markReported(1 << channel);
+                }
+                return true;
+            }
+            frame.part = FRAME_TRAILER;
+            // fall through
+
+        case FRAME_TRAILER:
+            frame.part = FRAME_CONTROL;
+            if (report && frame.door) {
+                gReportedDoorState = doorState();
+                gReportedDoorPosition = doorPosition();
+            }
+            if (frame.binary) {
+                printBinaryFrames(out, frame.sequence, 0, frame.door);
+                return true;
+            }
+            out.print(']');
+            if (frame.door) {
+                out.print(F(", \"door\": {"));
+                out.print(F("\"state\": \""));
+                out.print(doorStateName(doorState()));
+                out.print(F("\", "));
+                out.print(F("\"position\": "));
+                out.print(doorPosition(), DEC);
+                out.print('}');
+            }
+            return true;
+
+        case FRAME_CONTROL:
+            // status frames carry the controller, after the door
+            frame.part = FRAME_DONE;
+            if (frame.binary) {
+                if (frame.door) {
+                    printBinaryControl(out, frame.sequence);
                 }
-                Serial.print(sensors[i].tc.toJson());
-                printed = true;
+                return true;
+            }
+            if (frame.door) {
+                out.print(F(", "));
+                printControl(out);
+            }
+            out.println('}');
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+void serviceTx()
+{
+    for (;;) {
+        if (!gTxBuffer.empty()) {
+            if (Serial.availableForWrite() <= 0) {
+                return;     // TX buffer full; carry on next pass
+            }
+            PROFILE_SCOPE(WRITE);
+            if (!gTxBuffer.drain(Serial)) {
+                return;
             }
         }
-        Serial.print("]");
-        if (!gStreamingStatusEnabled) {
-            Serial.println("");
+
+        #ifdef DEBUG_FIRMWARE
+        if (gDebugLog.pending() && atLineBoundary()) {
+            if (!gDebugLog.drain(Serial)) {
+                return;
+            }
+            continue;
         }
+        #endif
 
-        if (gStreamingStatusEnabled) {
-            Serial.print(", \"door\": {");
-            Serial.print("\"state\": \"");
-            gDoorOpened ? Serial.print("open") : Serial.print("closed");
-            Serial.print("\", ");
-            Serial.print("\"position\": ");
-            gDoorOpened ? Serial.print(gDoorOpenPosition, DEC) : Serial.print(gDoorClosedPosition);
-            Serial.print("}");
+        if (gAlarmEvents.size() > 0) {
+            if (atLineBoundary()) {
+                alarm_event event;
+                gAlarmEvents.pop(event);
+                printAlarmEvent(gTxBuffer, event);
+                continue;
+            }
+            cutFrame();
         }
-        Serial.println('}');
 
-        if (gStreamingDelay > 0) {
-            delay(gStreamingDelay);
+        if (commandWaiting()) {
+            if (atLineBoundary()) {
+                return;     // serviceCommands() replies first
+            }
+            cutFrame();
+        }
+
+        bool rendered;
+        {
+            PROFILE_SCOPE(EMIT);
+            rendered = renderPiece(gTxBuffer, gFrame, true);
+        }
+        if (!rendered) {
+            gTxTask.stop();
+            if (gFramePending && !commandWaiting()) {
+                gFramePending = false;
+                startFrame();
+            }
+            return;
         }
     }
 }
+
+void loop()
+{
+    PROFILE_SCOPE(LOOP);
+    sample_timer::poll();
+    gCommandTask.poll();
+    gSampleTask.poll();
+    gEmitTask.poll();
+    #ifdef DEBUG_FIRMWARE
+    if (gDebugLog.pending() && !gTxTask.running()) {
+        gTxTask.start(0);
+    }
+    #endif
+    gTxTask.poll();
+    gControlTask.poll();
+    gDoorTask.poll();
+    gConfigStore.poll();
+}
@@ -1,4 +1,7 @@
 #include "max31855.h"
+#include "buffer_print.h"
+#include "fixed_point.h"
+#include "type_k.h"
 
 #include "stdlib.h"
 
@@ -6,9 +9,24 @@
 #include "SPI.h"
 #include "util/delay.h"
 
-sensor::temperature::thermocouple::max31855::Driver::Driver(uint8_t channel, int8_t chip_select)
+// Both constructors start from here, so a driver never reports a reading
+// it has not decoded: the cache is UNKNOWN until the first decode().
+sensor::temperature::thermocouple::max31855::Driver::Driver(uint8_t channel)
 {
   _channel = channel;
+  _chip_select = -1;
+  _conversion_started = 0;
+  _has_reading = false;
+  _last_reading = 0;
+  _last_status = status::UNKNOWN;
+  _last_value = 0;
+  _last_junction_ref = 0;
+  _last_corrected = 0;
+}
+
+sensor::temperature::thermocouple::max31855::Driver::Driver(uint8_t channel, int8_t chip_select)
+  : Driver(channel)
+{
   _chip_select = chip_select;
 
   // setup the chip select pin
@@ -17,17 +35,28 @@ sensor::temperature::thermocouple::max31855::Driver::Driver(uint8_t channel, int
   digitalWrite(_chip_select, HIGH);
 }
 
-void sensor::temperature::thermocouple::max31855::Driver::update()
+bool sensor::temperature::thermocouple::max31855::Driver::update()
 {
   uint32_t full_read;
-  full_read = _read_from_device();	// all data is packed into 4 8-bit registers
+  if (!sample(micros(), full_read)) {
+    return false;               // still converting, keep the cached values
+  }
+  return decode(full_read, millis());
+}
 
-  #ifdef DEBUG_FIRMWARE
-  Serial.print("# Read SPI value: ");
-  Serial.println(full_read);
-  #endif
+bool sensor::temperature::thermocouple::max31855::Driver::sample(uint32_t now, uint32_t &frame)
+{
+  if (_has_reading && (uint32_t)(now - _conversion_started) < CONVERSION_TIME_US) {
+    return false;
+  }
+  frame = _read_from_device();	// all data is packed into 4 8-bit registers
+  _conversion_started = now;
+  _has_reading = true;
+  return true;
+}
 
-  int16_t temp_i16;
+bool sensor::temperature::thermocouple::max31855::Driver::decode(uint32_t full_read, uint32_t time)
+{
   uint8_t temp_u8;
 
   // un-pack chip fault status
@@ -46,90 +75,152 @@ void sensor::temperature::thermocouple::max31855::Driver::update()
     else {
       _last_status = status::UNKNOWN;
     }
+    // a fault is not a value: start the filter over once it clears
+    _filter.reset();
   }
   else
   {
+    // TC temp is the signed 14-bit value in D31..D18: take the top word and
+    // shift the sign along. int16 with 2 bits of resolution (0.25 deg C per bit)
+    int16_t value = (int16_t)(full_read >> 16) >> 2;
+    if (!_filter.add(value, value)) {
+      return false;             // still oversampling
+    }
     _last_status = status::OK;
+    _last_value = value;
+  }
+  _last_reading = time;
 
-    // un-pack TC temp data
-    temp_i16 = (int16_t)(full_read >> 18);
-    if(0x2000 & temp_i16)       // negative value
-    {
-  	  temp_i16 &= 0x1FFF;       // save only first 13 bits of data
-  	  temp_i16 |= 0x8000;       // add on sign bit
-    }
-    else                        // positive value
-    {
-  	  temp_i16 &= 0x1FFF;       // no sign, save only first 13 (pos val)
-    }
-    // save TC temp. Note: int16 with 2 bits of
-    // resolution (2^-2 = 0.25 deg C per bit)
-    _last_value = temp_i16 * 0.25;
-    _last_reading = micros();   
+  // MAX31855 internal temp is the signed 12-bit value in D15..D4. int16 with
+  // 4 bits of resolution (0.0625 deg C per bit)
+  _last_junction_ref = (int16_t)(full_read & 0x0000FFF0) >> 4;
+
+  if (_last_status == status::OK) {
+    _last_corrected = type_k::linearize(_last_value, _last_junction_ref);
   }
+  return true;
+}
 
-  // un-pack MAX31855 internal temp data
-  temp_i16 = (int16_t)(full_read >> 4);
-  if(0x0800 & temp_i16)         // negative value
-  {
-	  temp_i16 &= 0x07FF;         // save only first 11 bits of data
-	  temp_i16 |= 0x8000;         // add on sign bit
+sensor::temperature::thermocouple::max31855::slot sensor::temperature::thermocouple::max31855::Driver::classify(uint32_t frame)
+{
+  if (frame == 0 || (frame & 0x00020008)) {
+    return slot::ABSENT;
   }
-  else                          // positive value
-  {
-	  temp_i16 &= 0x07FF;         // no sign, save only first 11 (pos val)
+  if ((frame & 0x00010000) && (frame & 0x00000001)) {
+    return slot::OPEN;
   }
-  // save TC temp. Note: int16 with 4 bits of
-  // resolution (2^-8 = 0.0625 deg C per bit)
-  _last_junction_ref = temp_i16 * 0.0625;
+  return slot::LIVE;
 }
 
-inline String status_to_string(sensor::temperature::thermocouple::status status)
+inline const __FlashStringHelper *status_to_string(sensor::temperature::thermocouple::status status)
 {
   switch(status)
   {
-    case sensor::temperature::thermocouple::status::UNKNOWN: return String("unknown error");
-    case sensor::temperature::thermocouple::status::OK: return String("okay");
-    case sensor::temperature::thermocouple::status::NOT_CONNECTED: return String("not connected");
-    case sensor::temperature::thermocouple::status::SHORT_TO_GROUND: return String("short to ground");
-    case sensor::temperature::thermocouple::status::SHORT_TO_VCC: return String ("short to Vcc");
-    default: return String("");
+    case sensor::temperature::thermocouple::status::UNKNOWN: return F("unknown error");
+    case sensor::temperature::thermocouple::status::OK: return F("okay");
+    case sensor::temperature::thermocouple::status::NOT_CONNECTED: return F("not connected");
+    case sensor::temperature::thermocouple::status::SHORT_TO_GROUND: return F("short to ground");
+    case sensor::temperature::thermocouple::status::SHORT_TO_VCC: return F("short to Vcc");
+    default: return F("");
   }
 }
 
+size_t sensor::temperature::thermocouple::max31855::Driver::printJson(Print &out)
+{
+  size_t n = 0;
+  n += out.print(F("{\"channel\": "));
+  n += out.print(_channel, DEC);
+  n += out.print(F(",\"status_code\": "));
+  n += out.print(static_cast<int>(_last_status), DEC);
+  n += out.print(F(",\"status\": \""));
+  n += out.print(status_to_string(_last_status));
+  n += out.print(F("\",\"junction\": "));
+  n += fixed::print(out, _last_junction_ref, fixed::SIXTEENTH_DEGREES);
+  n += out.print(F(",\"value\": "));
+  n += fixed::print(out, _last_value, fixed::QUARTER_DEGREES);
+  n += out.print(F(",\"corrected\": "));
+  n += fixed::print(out, _last_corrected, fixed::SIXTEENTH_DEGREES);
+  n += out.print(F(",\"time\": "));
+  n += out.print(_last_reading, DEC);
+  n += out.print('}');
+  return n;
+}
+
+size_t sensor::temperature::thermocouple::max31855::Driver::toJson(char *buffer, size_t size)
+{
+  BufferPrint out(buffer, size);
+  printJson(out);
+  return out.length();
+}
+
 String sensor::temperature::thermocouple::max31855::Driver::toJson()
 {
-  return String('{')
-   + String("\"channel\": ") + String(_channel) + String(',')
-   + String("\"status_code\": ") + String(static_cast<int>(_last_status), DEC)+ String(',')
-   + String("\"status\": \"") + status_to_string(_last_status) + String("\",")
-   + String("\"junction\": ") + String(_last_junction_ref, 3) + String(',')
-   + String("\"value\": ") + String(_last_value, 3) + 
-   String('}');
+  char buffer[JSON_MAX_LENGTH + 1];
+  toJson(buffer, sizeof(buffer));
+  return String(buffer);
+}
+
+void sensor::temperature::thermocouple::max31855::Driver::writeRecord(uint8_t *record)
+{
+  record[0] = _channel;
+  record[1] = (uint8_t)static_cast<int8_t>(_last_status);
+  record[2] = (uint8_t)_last_value;
+  record[3] = (uint8_t)(_last_value >> 8);
+  record[4] = (uint8_t)_last_junction_ref;
+  record[5] = (uint8_t)(_last_junction_ref >> 8);
+  record[6] = (uint8_t)_last_corrected;
+  record[7] = (uint8_t)(_last_corrected >> 8);
+  record[8] = (uint8_t)_last_reading;
+  record[9] = (uint8_t)(_last_reading >> 8);
+  record[10] = (uint8_t)(_last_reading >> 16);
+  record[11] = (uint8_t)(_last_reading >> 24);
 }
 
 double sensor::temperature::thermocouple::max31855::Driver::getTemperature()
 {
-  return _last_status == status::OK ? _last_reading : -1.0;
+  return _last_status == status::OK ? fixed::to_double(_last_value, fixed::QUARTER_DEGREES) : -1.0;
 }
 
 double sensor::temperature::thermocouple::max31855::Driver::getJunctionReference()
+{
+  return fixed::to_double(_last_junction_ref, fixed::SIXTEENTH_DEGREES);
+}
+
+uint32_t sensor::temperature::thermocouple::max31855::Driver::getTimestamp()
+{
+  return _last_reading;
+}
+
+int16_t sensor::temperature::thermocouple::max31855::Driver::getRawTemperature()
+{
+  return _last_value;
+}
+
+int16_t sensor::temperature::thermocouple::max31855::Driver::getRawJunctionReference()
 {
   return _last_junction_ref;
 }
 
+int16_t sensor::temperature::thermocouple::max31855::Driver::getRawCorrectedTemperature()
+{
+  return _last_corrected;
+}
+
 sensor::temperature::thermocouple::status sensor::temperature::thermocouple::max31855::Driver::getStatus()
 {
   return _last_status;
 }
 
+static const SPISettings max31855_spi_settings(sensor::temperature::thermocouple::max31855::Driver::SPI_CLOCK, MSBFIRST, SPI_MODE1);
+
 uint32_t sensor::temperature::thermocouple::max31855::Driver::_read_from_device(void)
 {
   // Function to read 32 bits of SPI data
   uint32_t four_bytes = 0;
   
+  SPI.beginTransaction(max31855_spi_settings);
   digitalWrite(_chip_select, LOW);    // set CS low
-  _delay_ms(1);                       // allow state transistion time
+  _delay_us(0.1);                     // tCSS, CS fall to SCK rise: 100 ns
   
   four_bytes |= SPI.transfer(0x00);   // read 1st byte
   four_bytes <<= 8;                   // shift data 1 byte left
@@ -139,6 +230,7 @@ uint32_t sensor::temperature::thermocouple::max31855::Driver::_read_from_device(
   four_bytes <<= 8;                   // shift data 1 byte left
   four_bytes |= SPI.transfer(0x00);   // read 4th byte
   
-  digitalWrite(_chip_select, HIGH);   // set CS high before leaving
+  digitalWrite(_chip_select, HIGH);   // set CS high, starts the next conversion
+  SPI.endTransaction();
   return four_bytes;
 }
\ No newline at end of file
@@ -4,6 +4,8 @@
 #include "stdint.h"
 #include "Arduino.h"
 
+#include "filter.h"
+
 namespace sensor {
   namespace temperature {
     namespace thermocouple {
@@ -21,25 +23,95 @@ namespace sensor {
         using status = sensor::temperature::thermocouple::status;
         using string = String;
 
+        // What a read found behind a chip select, see Driver::classify().
+        enum class slot : uint8_t {
+          ABSENT = 0,   // no chip answered
+          OPEN   = 1,   // a chip with no thermocouple on it
+          LIVE   = 2    // a chip and a thermocouple, faulty or not
+        };
+
         class Driver {
         public:
           Driver(uint8_t channel, int8_t chip_select);
+          // Decode only; for chips read by a Bank (see sensor_bank.h).
+          explicit Driver(uint8_t channel = 0);
           
-          void update();
+          // Reads the chip if it has finished a conversion since the last
+          // read, otherwise keeps the cached values. Returns true when that
+          // published a new reading.
+          bool update();
+
+          // update() in two halves, for reading from an interrupt and
+          // decoding in loop(). sample() only touches the bus and the
+          // conversion timer; decode() only the cached reading. time is when
+          // the frame was read, in millis(). decode() runs OK readings
+          // through filter() and returns false while it is still collecting
+          // conversions to oversample; the cached reading is unchanged then.
+          bool sample(uint32_t now, uint32_t &frame);
+          bool decode(uint32_t frame, uint32_t time);
+          // A frame with a reserved bit (D17, D3) set, or all zeros, is MISO
+          // floating rather than a chip. All zeros is also a real chip at
+          // exactly 0 C on both junctions, which a sweep will not see for
+          // long. Shorts count as LIVE: a thermocouple is wired, just badly.
+          static slot classify(uint32_t frame);
+
           double getTemperature();
           double getJunctionReference();
           status getStatus();
+          // millis() when the cached reading was read from the chip. A 32 bit
+          // millisecond count lasts 49 days, where micros() wraps after 71
+          // minutes.
+          uint32_t getTimestamp();
+
+          // Smoothing applied to readings between decode and publish; change
+          // it with Filter::configure(). Off by default.
+          Filter &filter() { return _filter; }
+
+          // Fixed point readings: thermocouple in 0.25 C and junction in
+          // 0.0625 C counts (see fixed_point.h).
+          int16_t getRawTemperature();
+          int16_t getRawJunctionReference();
+          // NIST linearized thermocouple temperature, 0.0625 C counts (see
+          // type_k.h). Only valid while the status is OK.
+          int16_t getRawCorrectedTemperature();
           
+          // Writes the channel record straight to the sink; no heap use.
+          size_t printJson(Print &out);
+          // Same record into a fixed buffer, truncated to fit. Returns the length.
+          size_t toJson(char *buffer, size_t size);
           string toJson();
+
+          // Longest record printJson() can produce, without the terminator.
+          static const size_t JSON_MAX_LENGTH = 153;
+
+          // The chip converts continuously but a read (CS low) aborts the
+          // conversion in progress, so it is only read again once a full
+          // conversion (100 ms worst case) has passed since the last one.
+          static const uint32_t CONVERSION_TIME_US = 100000;
+
+          // 5 MHz is the chip's limit; SPI_MODE1 is what these boards have
+          // always used.
+          static const uint32_t SPI_CLOCK = 4000000;
+
+          // Fixed layout binary record: channel, status code, the
+          // thermocouple, junction and corrected counts and the timestamp,
+          // little endian.
+          void writeRecord(uint8_t *record);
+          static const uint8_t RECORD_LENGTH = 12;
           
         private:
           uint8_t _channel;
           int8_t _chip_select;
           
-          uint64_t _last_reading;
+          uint32_t _last_reading;         // millis()
           status _last_status;
-          double _last_value;
-          double _last_junction_ref;
+          int16_t _last_value;            // 0.25 C per count
+          int16_t _last_junction_ref;     // 0.0625 C per count
+          int16_t _last_corrected;        // 0.0625 C per count
+
+          uint32_t _conversion_started;
+          bool _has_reading;
+          Filter _filter;
           
           uint32_t _read_from_device();
         };
@@ -0,0 +1,63 @@
+#ifndef _GGH_OUTPUT_BUFFER_H_
+#define _GGH_OUTPUT_BUFFER_H_
+
+#include "stdint.h"
+#include "Arduino.h"
+
+// Staging buffer between something that prints and a serial port that
+// must not block. Output is printed in whole pieces while the buffer is
+// empty, then drain() hands the port only as many bytes as its TX buffer
+// has room for. A piece that does not fit is truncated, so Size must cover
+// the largest piece.
+template <uint16_t Size>
+class OutputBuffer : public Print {
+public:
+  OutputBuffer() : _length(0), _sent(0) {}
+
+  virtual size_t write(uint8_t c)
+  {
+    if (_length >= Size) {
+      return 0;
+    }
+    _data[_length++] = c;
+    return 1;
+  }
+
+  using Print::write;
+
+  bool empty() const { return _sent == _length; }
+  uint16_t pending() const { return _length - _sent; }
+
+  void clear()
+  {
+    _length = 0;
+    _sent = 0;
+  }
+
+  // Writes what fits without blocking. Returns true once everything went.
+  template <typename Port>
+  bool drain(Port &port)
+  {
+    uint16_t count = pending();
+    int room = port.availableForWrite();
+    if (room <= 0) {
+      return empty();
+    }
+    if (count > (uint16_t)room) {
+      count = room;
+    }
+    _sent += port.write(_data + _sent, count);
+    if (empty()) {
+      clear();
+      return true;
+    }
+    return false;
+  }
+
+private:
+  uint8_t _data[Size];
+  uint16_t _length;
+  uint16_t _sent;
+};
+
+#endif // _GGH_OUTPUT_BUFFER_H_
@@ -0,0 +1,60 @@
+#include "pid.h"
+
+static const int32_t MAX_ERROR = 1024;                // 256 C in 0.25 C counts
+static const int32_t MAX_SCALED_GAIN = 1L << 20;
+
+static int32_t clamp(int32_t value, int32_t low, int32_t high)
+{
+  return value < low ? low : value > high ? high : value;
+}
+
+control::Pid::Pid()
+{
+  _kp = 0;
+  _ki = 0;
+  _kd = 0;
+  reset(0);
+}
+
+void control::Pid::setGains(uint32_t kp, uint32_t ki, uint32_t kd, uint16_t period_ms)
+{
+  if (period_ms == 0) {
+    period_ms = 1;
+  }
+  kp = kp > MAX_GAIN ? MAX_GAIN : kp;
+  ki = ki > MAX_GAIN ? MAX_GAIN : ki;
+  kd = kd > MAX_GAIN ? MAX_GAIN : kd;
+
+  // A permille per C is 2^12 / 4 = 1024 per count; the gains come in
+  // thousandths of that.
+  _kp = clamp((int32_t)(kp * 1024 / 1000), 0, MAX_SCALED_GAIN);
+  _ki = clamp((int32_t)((uint64_t)ki * period_ms * (1024 << 8) / 1000000), 0, MAX_SCALED_GAIN);
+  _kd = clamp((int32_t)((uint64_t)kd * 1024 / period_ms), 0, MAX_SCALED_GAIN);
+}
+
+void control::Pid::reset(int16_t output)
+{
+  _output = (int16_t)clamp(output, 0, OUTPUT_MAX);
+  _integral = (int32_t)_output << FRACTION_BITS;
+  _p = 0;
+  _d = 0;
+  _primed = false;
+}
+
+int16_t control::Pid::update(int16_t setpoint, int16_t measured)
+{
+  const int32_t limit = (int32_t)OUTPUT_MAX << FRACTION_BITS;
+
+  int32_t error = clamp((int32_t)measured - setpoint, -MAX_ERROR, MAX_ERROR);
+  int32_t change = _primed ? clamp((int32_t)measured - _last_measured, -MAX_ERROR, MAX_ERROR) : 0;
+  _last_measured = measured;
+  _primed = true;
+
+  // p and d beyond twice the output range cannot change the result
+  _p = clamp(_kp * error, -2 * limit, 2 * limit);
+  _d = clamp(_kd * change, -2 * limit, 2 * limit);
+  _integral = clamp(_integral + ((_ki * error) >> 8), 0, limit);
+
+  _output = (int16_t)(clamp(_p + _integral + _d, 0, limit) >> FRACTION_BITS);
+  return _output;
+}
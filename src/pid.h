@@ -0,0 +1,61 @@
+#ifndef _GGH_PID_H_
+#define _GGH_PID_H_
+
+#include "stdint.h"
+#include "Arduino.h"
+
+namespace control {
+
+  // Fixed point PID for a door that opens to cool: the output rises while
+  // the measurement is above the setpoint. Measurements and setpoint are
+  // 0.25 C counts (see fixed_point.h) and the output is the door's travel in
+  // permille, 0 closed to OUTPUT_MAX open. update() is meant to be called
+  // at a fixed period, given to setGains().
+  //
+  // Gains are entered in thousandths of a permille of travel per C (kp),
+  // per C and second (ki) and per C per second (kd). Inside, every term is
+  // an int32 with 12 fraction bits. The error and the change of the
+  // measurement are clamped to +-256 C and each scaled gain to 2^20, which
+  // keeps every product inside 31 bits.
+  //
+  // The derivative acts on the measurement, so a setpoint step does not
+  // kick the door, and the integral is held within the output range so it
+  // does not wind up while the door is against a stop.
+  class Pid {
+  public:
+    static const int16_t OUTPUT_MAX = 1000;
+    static const uint32_t MAX_GAIN = 1000000;
+
+    Pid();
+
+    void setGains(uint32_t kp, uint32_t ki, uint32_t kd, uint16_t period_ms);
+
+    // Starts over, with the integral holding output so the door does not
+    // jump when control takes over.
+    void reset(int16_t output);
+
+    // One control step. Returns the new output.
+    int16_t update(int16_t setpoint, int16_t measured);
+
+    int16_t output() const { return _output; }
+    // The terms of the last update(), in permille.
+    int16_t proportional() const { return (int16_t)(_p >> FRACTION_BITS); }
+    int16_t integral() const { return (int16_t)(_integral >> FRACTION_BITS); }
+    int16_t derivative() const { return (int16_t)(_d >> FRACTION_BITS); }
+
+  private:
+    static const uint8_t FRACTION_BITS = 12;
+
+    int32_t _kp;          // per count
+    int32_t _ki;          // per count and period, 8 more fraction bits
+    int32_t _kd;          // per count of change in a period
+    int32_t _p;
+    int32_t _integral;
+    int32_t _d;
+    int16_t _last_measured;
+    bool _primed;
+    int16_t _output;
+  };
+};
+
+#endif // _GGH_PID_H_
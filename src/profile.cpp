@@ -0,0 +1,111 @@
+#include "profile.h"
+
+#ifdef PROFILE_FIRMWARE
+
+static profile::stats stages[profile::STAGE_COUNT];
+static uint16_t late_frames = 0;
+static uint16_t min_free_ram = 0xffff;
+static uint16_t dropped_before = 0;
+
+void profile::record(stage s, uint32_t elapsed)
+{
+  uint16_t us = elapsed > 0xffff ? 0xffff : (uint16_t)elapsed;
+  stats &st = stages[s];
+  st.count++;
+  st.total += us;
+  if (st.count == 1 || us < st.min) {
+    st.min = us;
+  }
+  if (us > st.max) {
+    st.max = us;
+  }
+
+  if (s == LOOP) {
+    uint16_t free = freeRam();
+    if (free < min_free_ram) {
+      min_free_ram = free;
+    }
+  }
+}
+
+void profile::lateFrame()
+{
+  late_frames++;
+}
+
+#ifdef __AVR__
+extern char __heap_start;
+extern char *__brkval;
+
+uint16_t profile::freeRam()
+{
+  char top;
+  return &top - (__brkval ? __brkval : &__heap_start);
+}
+#else
+uint16_t profile::freeRam()
+{
+  return 0;
+}
+#endif
+
+static const __FlashStringHelper *stage_name(uint8_t s)
+{
+  switch (s)
+  {
+    case profile::SWEEP: return F("sweep");
+    case profile::DECODE: return F("decode");
+    case profile::EMIT: return F("emit");
+    case profile::WRITE: return F("write");
+    case profile::COMMAND: return F("command");
+    case profile::LOOP: return F("loop");
+    default: return F("");
+  }
+}
+
+size_t profile::report(Print &out, uint16_t overflows)
+{
+  stats copy[STAGE_COUNT];
+  noInterrupts();         // the sweep stage is written by the interrupt
+  for (uint8_t i = 0; i < STAGE_COUNT; i++) {
+    copy[i] = stages[i];
+    stages[i].count = 0;
+    stages[i].total = 0;
+    stages[i].max = 0;
+  }
+  interrupts();
+
+  size_t n = out.print(F("{ \"profile\": {"));
+  for (uint8_t i = 0; i < STAGE_COUNT; i++) {
+    const stats &s = copy[i];
+    n += out.print('"');
+    n += out.print(stage_name(i));
+    n += out.print(F("\": {\"count\": "));
+    n += out.print(s.count, DEC);
+    n += out.print(F(", \"min\": "));
+    n += out.print(s.count ? s.min : 0U, DEC);
+    n += out.print(F(", \"max\": "));
+    n += out.print(s.max, DEC);
+    n += out.print(F(", \"avg\": "));
+    n += out.print(s.count ? s.total / s.count : 0UL, DEC);
+    n += out.print(F(", \"total\": "));
+    n += out.print(s.total, DEC);
+    n += out.print(F("}, "));
+  }
+  n += out.print(F("\"dropped\": "));
+  n += out.print((uint16_t)(overflows - dropped_before), DEC);
+  n += out.print(F(", \"late\": "));
+  n += out.print(late_frames, DEC);
+  n += out.print(F(", \"free_ram\": "));
+  n += out.print(freeRam(), DEC);
+  n += out.print(F(", \"min_free_ram\": "));
+  n += out.print(min_free_ram == 0xffff ? freeRam() : min_free_ram, DEC);
+  n += out.println(F("}}"));
+
+  late_frames = 0;
+  min_free_ram = 0xffff;
+  dropped_before = overflows;
+  return n;
+}
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef _GGH_PROFILE_H_
+#define _GGH_PROFILE_H_
+
+#include "stdint.h"
+#include "Arduino.h"
+
+// Stage timing for the sampling and emit path, reported and reset by the P
+// command. Only built with -DPROFILE_FIRMWARE; without it the macros below
+// expand to nothing, this namespace is empty and P is an unknown command.
+//
+// Times are micros() differences, so 4 us resolution on a 16 MHz AVR.
+//
+//   sweep    reading the chips, in the sampling interrupt
+//   decode   decoding one queued sweep into the channels
+//   emit     rendering one piece of a streamed frame into the staging buffer
+//   write    handing staged bytes to Serial; only what fits the TX buffer
+//            is written, so this never waits on the link
+//   command  one command, from dispatch to its reply
+//   loop     one loop() pass
+#ifdef PROFILE_FIRMWARE
+
+namespace profile {
+
+  enum stage : uint8_t {
+    SWEEP,
+    DECODE,
+    EMIT,
+    WRITE,
+    COMMAND,
+    LOOP,
+    STAGE_COUNT
+  };
+
+  struct stats {
+    uint32_t count;
+    uint32_t total;
+    uint16_t min;
+    uint16_t max;
+  };
+
+  // Safe to call from the sampling interrupt.
+  void record(stage s, uint32_t elapsed);
+
+  // A streamed frame that went out a period or more behind schedule.
+  void lateFrame();
+
+  // Gap between the top of the heap and the stack, in bytes; 0 on the host.
+  uint16_t freeRam();
+
+  // { "profile": {"sweep": {...}, ..., "dropped": 0, "late": 0, ...} }
+  // then resets everything. overflows is the sample queue's running count
+  // of dropped sweeps; the report shows the increase since the last one.
+  size_t report(Print &out, uint16_t overflows);
+
+  class Scope {
+  public:
+    explicit Scope(stage s) : _stage(s), _start(micros()) {}
+    ~Scope() { record(_stage, micros() - _start); }
+
+  private:
+    stage _stage;
+    uint32_t _start;
+  };
+};
+
+  #define PROFILE_SCOPE(s) profile::Scope _profile_scope(profile::s)
+  #define PROFILE_LATE_FRAME() profile::lateFrame()
+
+#else
+
+  #define PROFILE_SCOPE(s)
+  #define PROFILE_LATE_FRAME()
+
+#endif
+
+#endif // _GGH_PROFILE_H_
@@ -0,0 +1,76 @@
+#ifndef _GGH_SAMPLE_PLANNER_H_
+#define _GGH_SAMPLE_PLANNER_H_
+
+#include "stdint.h"
+#include "Arduino.h"
+
+namespace sampling {
+
+  // Per channel sampling periods for a bank whose chips are read together.
+  // Every time the bank has a conversion ready, due() picks the channels
+  // whose period has come round, so channels at different rates still share
+  // one SPI burst and the others are not read at all. A channel is due at
+  // most once a conversion, so periods below MIN_PERIOD_MS read it on every
+  // one. Deadlines advance by the period rather than from the read, so a
+  // channel keeps its average rate, jittered by at most one conversion.
+  //
+  // due() runs in the sampling interrupt. Periods are 16 bits, so change
+  // them with setPeriod(), which holds the interrupt off while it writes.
+  template <uint8_t Channels>
+  class Planner {
+  public:
+    static const uint16_t MIN_PERIOD_MS = 100;    // one conversion
+
+    Planner()
+    {
+      for (uint8_t i = 0; i < Channels; i++) {
+        _period[i] = MIN_PERIOD_MS;
+        _next[i] = 0;
+      }
+    }
+
+    uint16_t period(uint8_t channel) const
+    {
+      noInterrupts();
+      uint16_t period = _period[channel];
+      interrupts();
+      return period;
+    }
+
+    // The channel is next due at once, so a new period takes effect
+    // without waiting out the old one.
+    void setPeriod(uint8_t channel, uint16_t ms)
+    {
+      noInterrupts();
+      _period[channel] = ms < MIN_PERIOD_MS ? MIN_PERIOD_MS : ms;
+      _next[channel] = millis();
+      interrupts();
+    }
+
+    // The channels of candidates due at now (millis()), which are then
+    // moved to their next deadline.
+    uint8_t due(uint32_t now, uint8_t candidates)
+    {
+      uint8_t channels = 0;
+      for (uint8_t i = 0; i < Channels; i++) {
+        if (!(candidates & (1 << i)) || (int32_t)(now - _next[i]) < 0) {
+          continue;
+        }
+        channels |= 1 << i;
+        _next[i] += _period[i];
+        if ((int32_t)(now - _next[i]) >= 0) {
+          // more than a period behind, e.g. just enabled; start over
+          // from now instead of reading it on every conversion
+          _next[i] = now + _period[i];
+        }
+      }
+      return channels;
+    }
+
+  private:
+    uint16_t _period[Channels];
+    uint32_t _next[Channels];
+  };
+};
+
+#endif // _GGH_SAMPLE_PLANNER_H_
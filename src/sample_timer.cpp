@@ -0,0 +1,59 @@
+#include "sample_timer.h"
+
+#ifdef __AVR__
+  #include <avr/io.h>
+  #include <avr/interrupt.h>
+#endif
+
+static void (*volatile tick_callback)() = NULL;
+
+#ifdef __AVR__
+
+ISR(TIMER2_COMPA_vect)
+{
+  tick_callback();
+}
+
+void sample_timer::begin(void (*tick)())
+{
+  noInterrupts();
+  tick_callback = tick;
+  // CTC mode, clk/128: 125 kHz at 16 MHz, so 125 counts per millisecond
+  TCCR2A = _BV(WGM21);
+  TCCR2B = _BV(CS22) | _BV(CS20);
+  OCR2A = (uint8_t)(F_CPU / 128 / (1000000UL / TICK_US) - 1);
+  TCNT2 = 0;
+  TIMSK2 = _BV(OCIE2A);
+  interrupts();
+}
+
+void sample_timer::poll()
+{
+}
+
+#else
+
+static uint32_t next_tick_us;
+
+void sample_timer::begin(void (*tick)())
+{
+  tick_callback = tick;
+  next_tick_us = micros() + TICK_US;
+}
+
+void sample_timer::poll()
+{
+  if (!tick_callback) {
+    return;
+  }
+  uint32_t now = micros();
+  if ((int32_t)(now - next_tick_us) > (int32_t)(100 * TICK_US)) {
+    next_tick_us = now;     // far behind (e.g. a debugger); don't replay
+  }
+  while ((int32_t)(now - next_tick_us) >= 0) {
+    tick_callback();
+    next_tick_us += TICK_US;
+  }
+}
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef _GGH_SAMPLE_TIMER_H_
+#define _GGH_SAMPLE_TIMER_H_
+
+#include "stdint.h"
+#include "Arduino.h"
+
+// 1 ms tick on Timer2 for sampling; Timer1 belongs to Servo and Timer0 to
+// millis(). The callback runs in interrupt context, so it must be short and
+// must not print.
+namespace sample_timer {
+
+  static const uint16_t TICK_US = 1000;
+
+  void begin(void (*tick)());
+
+  // Host builds have no timer interrupt; there loop() calls this to run the
+  // ticks that are due. It does nothing on the AVR.
+  void poll();
+};
+
+#endif // _GGH_SAMPLE_TIMER_H_
@@ -0,0 +1,47 @@
+#include "scheduler.h"
+#include "profile.h"
+
+scheduler::Task::Task(void (*run)(), bool frames)
+{
+  _run = run;
+  _period = 0;
+  _next = 0;
+  _running = false;
+  _frames = frames;
+}
+
+void scheduler::Task::start(uint16_t period)
+{
+  _period = period;
+  _next = millis();
+  _running = true;
+}
+
+void scheduler::Task::stop()
+{
+  _running = false;
+}
+
+bool scheduler::Task::poll()
+{
+  if (!_running) {
+    return false;
+  }
+
+  uint32_t now = millis();
+  if ((int32_t)(now - _next) < 0) {
+    return false;
+  }
+
+  _next += _period;
+  if ((int32_t)(now - _next) >= 0) {
+    // fell more than a period behind; skip the missed slots instead of
+    // running them back to back
+    _next = now + _period;
+    if (_period && _frames) {
+      PROFILE_LATE_FRAME();
+    }
+  }
+  _run();
+  return true;
+}
@@ -0,0 +1,35 @@
+#ifndef _GGH_SCHEDULER_H_
+#define _GGH_SCHEDULER_H_
+
+#include "stdint.h"
+#include "Arduino.h"
+
+namespace scheduler {
+
+  // Cooperative task driven from loop(). A started task runs every period
+  // milliseconds, measured between deadlines rather than from the end of the
+  // previous run, so its cadence does not drift with its own run time. A
+  // period of 0 runs on every poll.
+  class Task {
+  public:
+    // frames marks the task that emits the stream: only its falling
+    // behind counts as a late frame for the profiler (see profile.h).
+    explicit Task(void (*run)(), bool frames = false);
+
+    void start(uint16_t period);
+    void stop();
+    bool running() const { return _running; }
+
+    // Runs the task if it is due. Returns true if it ran.
+    bool poll();
+
+  private:
+    void (*_run)();
+    uint16_t _period;
+    uint32_t _next;
+    bool _running;
+    bool _frames;
+  };
+};
+
+#endif // _GGH_SCHEDULER_H_
@@ -0,0 +1,118 @@
+#ifndef _GGH_SENSOR_BANK_H_
+#define _GGH_SENSOR_BANK_H_
+
+#include "stdint.h"
+#include "Arduino.h"
+#include "SPI.h"
+#include "util/delay.h"
+
+#include "fast_pin.h"
+#include "max31855.h"
+
+namespace sensor {
+  namespace temperature {
+    namespace thermocouple {
+      namespace max31855 {
+
+        // The MAX31855 chips of a board, declared by their chip select pins
+        // in channel order:
+        //
+        //   using quad_board = Bank<10, 9, 8, 7>;
+        //
+        // The pins are template arguments, so every read below is expanded
+        // per chip at compile time with its chip select resolved to a port
+        // bit (see fast_pin.h). There is no loop; the only per channel work
+        // is testing its bit in the mask of channels to read.
+        //
+        // All chips are read in the same sweep and so restart their
+        // conversions together; the bank tracks one conversion for all of
+        // them. Frames are only decoded, and channels enabled or disabled,
+        // on the Driver side.
+        template <uint8_t... ChipSelects>
+        class Bank {
+        public:
+          static constexpr uint8_t SIZE = sizeof...(ChipSelects);
+
+          Bank() : _conversion_started(0), _has_reading(false) {}
+
+          static uint8_t chipSelect(uint8_t channel)
+          {
+            static const uint8_t pins[SIZE] = { ChipSelects... };
+            return pins[channel];
+          }
+
+          static void begin()
+          {
+            (void)expand{ 0, (io::OutputPin<ChipSelects>::begin(), 0)... };
+          }
+
+          // True once a full conversion has passed since the last sweep, see
+          // Driver::CONVERSION_TIME_US.
+          bool due(uint32_t now) const
+          {
+            return !_has_reading || (uint32_t)(now - _conversion_started) >= Driver::CONVERSION_TIME_US;
+          }
+
+          static constexpr uint8_t ALL = (uint8_t)((1u << SIZE) - 1);
+
+          // Reads the chips of the channels set in the mask into their
+          // frames[0..SIZE) slot if due(); the other slots are left alone and
+          // those chips keep converting. Returns true if it was due.
+          bool sweep(uint32_t now, uint32_t *frames, uint8_t channels = ALL)
+          {
+            if (!due(now)) {
+              return false;
+            }
+            if (channels) {
+              uint8_t bit = 1;
+              SPI.beginTransaction(SPISettings(Driver::SPI_CLOCK, MSBFIRST, SPI_MODE1));
+              (void)expand{ 0, (readIf<ChipSelects>(channels, bit, frames), 0)... };
+              SPI.endTransaction();
+            }
+            _conversion_started = now;
+            _has_reading = true;
+            return true;
+          }
+
+        private:
+          // braced lists are evaluated left to right, which keeps the chips
+          // in channel order
+          typedef int expand[];
+
+          uint32_t _conversion_started;
+          bool _has_reading;
+
+          template <uint8_t Pin>
+          static void readIf(uint8_t channels, uint8_t &bit, uint32_t *&frames)
+          {
+            if (channels & bit) {
+              *frames = readFrame<Pin>();
+            }
+            frames++;
+            bit <<= 1;
+          }
+
+          template <uint8_t Pin>
+          static uint32_t readFrame()
+          {
+            io::OutputPin<Pin>::low();
+            _delay_us(0.1);                   // tCSS, CS fall to SCK rise: 100 ns
+            uint32_t frame = SPI.transfer(0x00);
+            frame = (frame << 8) | SPI.transfer(0x00);
+            frame = (frame << 8) | SPI.transfer(0x00);
+            frame = (frame << 8) | SPI.transfer(0x00);
+            io::OutputPin<Pin>::high();       // starts the next conversion
+            return frame;
+          }
+        };
+
+        template <uint8_t... ChipSelects>
+        constexpr uint8_t Bank<ChipSelects...>::SIZE;
+        template <uint8_t... ChipSelects>
+        constexpr uint8_t Bank<ChipSelects...>::ALL;
+      };
+    };
+  };
+};
+
+#endif // _GGH_SENSOR_BANK_H_
@@ -0,0 +1,68 @@
+#ifndef _GGH_SPSC_QUEUE_H_
+#define _GGH_SPSC_QUEUE_H_
+
+#include "stdint.h"
+#include "Arduino.h"
+
+// Lock-free ring for one producer (an interrupt) and one consumer (loop()).
+// Each side only writes its own index, and the indices are single bytes,
+// so they are read and written atomically on the AVR without disabling
+// interrupts. Size must be a power of two; one slot stays empty. A push
+// into a full queue is dropped and counted.
+template <typename T, uint8_t Size>
+class SpscQueue {
+  static_assert(Size >= 2 && (Size & (Size - 1)) == 0, "Size must be a power of two");
+
+public:
+  SpscQueue() : _head(0), _tail(0), _overflows(0) {}
+
+  // Producer side.
+  bool push(const T &item)
+  {
+    uint8_t head = _head;
+    uint8_t next = (head + 1) & (Size - 1);
+    if (next == _tail) {
+      _overflows++;
+      return false;
+    }
+    _items[head] = item;
+    barrier();              // item is written before it is published
+    _head = next;
+    return true;
+  }
+
+  // Consumer side.
+  bool pop(T &item)
+  {
+    uint8_t tail = _tail;
+    if (tail == _head) {
+      return false;
+    }
+    barrier();
+    item = _items[tail];
+    barrier();              // item is read before the slot is released
+    _tail = (tail + 1) & (Size - 1);
+    return true;
+  }
+
+  uint8_t size() const { return (_head - _tail) & (Size - 1); }
+
+  // 16 bits, so read it with the producer held off.
+  uint16_t overflows() const
+  {
+    noInterrupts();
+    uint16_t overflows = _overflows;
+    interrupts();
+    return overflows;
+  }
+
+private:
+  static inline void barrier() { asm volatile("" ::: "memory"); }
+
+  T _items[Size];
+  volatile uint8_t _head;
+  volatile uint8_t _tail;
+  volatile uint16_t _overflows;
+};
+
+#endif // _GGH_SPSC_QUEUE_H_
@@ -0,0 +1,86 @@
+#include "type_k.h"
+#include "type_k_reference.h"
+
+namespace type_k = sensor::temperature::thermocouple::type_k;
+namespace reference = type_k::reference;
+
+static const uint16_t TABLE_SIZE = (type_k::TABLE_MAX - type_k::TABLE_MIN) / type_k::TABLE_STEP + 1;
+
+static constexpr uint16_t table_entry(int i)
+{
+  return reference::entry<double>(type_k::TABLE_MIN + i * type_k::TABLE_STEP);
+}
+
+template <int... Is> struct sequence {};
+template <int N, int... Is> struct make_sequence : make_sequence<N - 1, N - 1, Is...> {};
+template <int... Is> struct make_sequence<0, Is...> { typedef sequence<Is...> type; };
+
+template <typename Sequence> struct emf_table;
+template <int... Is> struct emf_table<sequence<Is...> > {
+  static constexpr uint16_t values[sizeof...(Is)] PROGMEM = { table_entry(Is)... };
+};
+template <int... Is> constexpr uint16_t emf_table<sequence<Is...> >::values[sizeof...(Is)] PROGMEM;
+
+static const uint16_t *const EMF = emf_table<make_sequence<TABLE_SIZE>::type>::values;
+
+static int32_t emf_at(uint16_t i)
+{
+  return (int32_t)pgm_read_word(&EMF[i]) + reference::EMF_OFFSET;
+}
+
+// Table entries are TABLE_STEP * 16 = 128 counts of 0.0625 C apart.
+static const uint8_t STEP_SHIFT = 7;
+
+int32_t type_k::emf(int16_t temperature)
+{
+  int32_t offset = (int32_t)temperature - (int32_t)TABLE_MIN * 16;
+  if (offset <= 0) {
+    return emf_at(0);
+  }
+  uint16_t i = offset >> STEP_SHIFT;
+  if (i >= TABLE_SIZE - 1) {
+    return emf_at(TABLE_SIZE - 1);
+  }
+  int32_t low = emf_at(i);
+  int32_t fraction = offset & ((1 << STEP_SHIFT) - 1);
+  return low + (((emf_at(i + 1) - low) * fraction + (1 << (STEP_SHIFT - 1))) >> STEP_SHIFT);
+}
+
+int16_t type_k::temperature(int32_t emf)
+{
+  if (emf <= emf_at(0)) {
+    return TABLE_MIN * 16;
+  }
+  if (emf >= emf_at(TABLE_SIZE - 1)) {
+    return TABLE_MAX * 16;
+  }
+
+  // the reference function is monotonic: find low with
+  // EMF[low] <= emf < EMF[low + 1]
+  uint16_t low = 0;
+  uint16_t high = TABLE_SIZE - 1;
+  while (high - low > 1) {
+    uint16_t middle = (low + high) / 2;
+    if (emf_at(middle) <= emf) {
+      low = middle;
+    }
+    else {
+      high = middle;
+    }
+  }
+
+  int32_t base = emf_at(low);
+  int32_t span = emf_at(high) - base;
+  int32_t fraction = (((emf - base) << STEP_SHIFT) + span / 2) / span;
+  return (int16_t)(((int32_t)TABLE_MIN * 16) + ((int32_t)low << STEP_SHIFT) + fraction);
+}
+
+int16_t type_k::linearize(int16_t thermocouple, int16_t junction)
+{
+  // V = (T - T_junction) * 41.276 uV/C; in 0.0625 C counts that is
+  // 2579.75 nV = 10319 / 4 nV per count.
+  int32_t difference = (int32_t)thermocouple * 4 - junction;
+  int32_t product = difference * 10319;
+  int32_t measured = (product + (product < 0 ? -2000 : 2000)) / 4000;
+  return temperature(measured + emf(junction));
+}
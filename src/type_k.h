@@ -0,0 +1,46 @@
+#ifndef _GGH_TYPE_K_H_
+#define _GGH_TYPE_K_H_
+
+#include "stdint.h"
+#include "Arduino.h"
+
+namespace sensor {
+  namespace temperature {
+    namespace thermocouple {
+
+      // NIST ITS-90 Type K linearization for the MAX31855.
+      //
+      // The chip assumes a constant 41.276 uV/C and reports
+      //
+      //   T = T_junction + V / 41.276 uV/C
+      //
+      // which is several degrees off over most of the range. linearize()
+      // recovers V from the reported pair, adds the EMF of the cold junction
+      // and inverts the NIST reference function.
+      //
+      // The reference function is tabulated every TABLE_STEP degrees at
+      // compile time (see type_k.cpp) into PROGMEM; both directions
+      // interpolate linearly between entries, so no floating point runs on
+      // the device.
+      namespace type_k {
+
+        static const int16_t TABLE_MIN = -256;    // C
+        static const int16_t TABLE_MAX = 1376;    // C
+        static const uint8_t TABLE_STEP = 8;      // C
+
+        // EMF in uV for a temperature in 0.0625 C counts.
+        int32_t emf(int16_t temperature);
+
+        // Temperature in 0.0625 C counts for an EMF in uV, clamped to the
+        // table range.
+        int16_t temperature(int32_t emf);
+
+        // Corrected hot junction temperature in 0.0625 C counts, from the
+        // chip's thermocouple (0.25 C) and junction (0.0625 C) counts.
+        int16_t linearize(int16_t thermocouple, int16_t junction);
+      };
+    };
+  };
+};
+
+#endif // _GGH_TYPE_K_H_
@@ -0,0 +1,85 @@
+#ifndef _GGH_TYPE_K_REFERENCE_H_
+#define _GGH_TYPE_K_REFERENCE_H_
+
+#include "stdint.h"
+
+namespace sensor {
+  namespace temperature {
+    namespace thermocouple {
+      namespace type_k {
+
+        // Reference function from NIST Monograph 175, in mV for t in C:
+        //
+        //   -270..0 C:  E = sum c_i t^i
+        //   0..1372 C:  E = sum c_i t^i + a0 exp(a1 (t - a2)^2)
+        //
+        // Everything here is constexpr, for type_k.cpp to fold into its
+        // table, and evaluated in Real. type_k.cpp uses double, which is
+        // 32 bits under avr-gcc, so the benchmarks also run it in float to
+        // check the table the board actually gets.
+        namespace reference {
+
+          static constexpr double NEGATIVE[] = {
+            0.000000000000E+00,  0.394501280250E-01,  0.236223735980E-04,
+           -0.328589067840E-06, -0.499048287770E-08, -0.675090591730E-10,
+           -0.574103274280E-12, -0.310888728940E-14, -0.104516093650E-16,
+           -0.198892668780E-19, -0.163226974860E-22
+          };
+
+          static constexpr double POSITIVE[] = {
+           -0.176004136860E-01,  0.389212049750E-01,  0.185587700320E-04,
+           -0.994575928740E-07,  0.318409457190E-09, -0.560728448890E-12,
+            0.560750590590E-15, -0.320207200030E-18,  0.971511471520E-22,
+           -0.121047212750E-25
+          };
+
+          static constexpr double A0 = 0.118597600000E+00;
+          static constexpr double A1 = -0.118343200000E-03;
+          static constexpr double A2 = 0.126968600000E+03;
+
+          template <typename Real> constexpr Real horner(const double *c, int n, Real t)
+          {
+            return n == 1 ? (Real)c[0] : (Real)c[0] + t * horner(c + 1, n - 1, t);
+          }
+
+          // exp() by halving the argument into [-1, 1], a Taylor series
+          // there and squaring back up.
+          template <typename Real> constexpr Real taylor_exp(Real x, int n, Real term)
+          {
+            return n > 14 ? term : term + taylor_exp(x, n + 1, term * x / n);
+          }
+
+          template <typename Real> constexpr Real square(Real x)
+          {
+            return x * x;
+          }
+
+          template <typename Real> constexpr Real exp(Real x)
+          {
+            return x < -1 || x > 1 ? square(exp(x / 2)) : taylor_exp(x, 1, (Real)1);
+          }
+
+          template <typename Real> constexpr Real mv(Real t)
+          {
+            return t < 0
+              ? horner(NEGATIVE, sizeof(NEGATIVE) / sizeof(NEGATIVE[0]), t)
+              : horner(POSITIVE, sizeof(POSITIVE) / sizeof(POSITIVE[0]), t) +
+                (Real)A0 * exp((Real)A1 * square(t - (Real)A2));
+          }
+
+          // Table entries are stored as uint16 uV above EMF_OFFSET, which is
+          // below the -6.458 mV of -270 C; 1376 C is 55.0 mV, so everything
+          // fits.
+          static const int32_t EMF_OFFSET = -6500;
+
+          template <typename Real> constexpr uint16_t entry(int16_t t)
+          {
+            return (uint16_t)(mv((Real)t) * (Real)1000 - (Real)EMF_OFFSET + (Real)0.5);
+          }
+        };
+      };
+    };
+  };
+};
+
+#endif // _GGH_TYPE_K_REFERENCE_H_
@@ -0,0 +1,36 @@
+#
+# Fails an AVR build whose static RAM (.data + .bss) leaves less than
+# custom_stack_reserve bytes of the board's RAM for the stack. PlatformIO
+# itself only warns once .data + .bss is past all of it.
+#
+#   extra_scripts        = post:tools/check_ram.py
+#   custom_stack_reserve = 256
+#
+import subprocess
+
+Import("env")
+
+
+def static_ram(elf):
+    output = subprocess.check_output([env.subst("$SIZETOOL"), "-A", elf])
+    used = 0
+    for line in output.decode().splitlines():
+        fields = line.split()
+        if len(fields) >= 2 and fields[0] in (".data", ".bss", ".noinit"):
+            used += int(fields[1])
+    return used
+
+
+def check_ram(source, target, env):
+    total = int(env.BoardConfig().get("upload.maximum_ram_size"))
+    reserve = int(env.GetProjectOption("custom_stack_reserve", "0"))
+    used = static_ram(target[0].get_abspath())
+    print("Static RAM: %d of %d bytes, %d left for the stack (%d reserved)"
+          % (used, total, total - used, reserve))
+    if used + reserve > total:
+        print("Error: .data + .bss is %d bytes over what leaves the stack %d bytes"
+              % (used + reserve - total, reserve))
+        env.Exit(1)
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", check_ram)